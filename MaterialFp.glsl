@@ -11,6 +11,54 @@ uniform vec4 specular_colour;
 uniform float ambient_amount;
 uniform float phong_exponent;
 
+#ifndef UNCLUSTERED
+// Clustered lighting data, filled every frame on the CPU
+uniform mat4 projection_mat;
+uniform sampler2D light_tex; // Per light: view position and radius, colour
+uniform sampler2D cluster_tex; // Per cluster: offset into the index list, light count
+uniform sampler2D light_index_tex; // Light indices, four per texel
+uniform vec3 cluster_dims; // Number of clusters along x, y and z
+uniform vec3 slice_params; // Depth slice = log(depth)*scale + bias
+
+
+// Find the cluster of the fragment and accumulate the lights binned into it
+void cluster_lighting(vec3 N, vec3 V, out vec3 diffuse, out vec3 specular)
+{
+    diffuse = vec3(0.0);
+    specular = vec3(0.0);
+
+    vec4 clip = projection_mat * vec4(position_interp, 1.0);
+    vec2 ndc = clip.xy / clip.w;
+    ivec3 dims = ivec3(cluster_dims);
+    int x = clamp(int((ndc.x*0.5 + 0.5)*cluster_dims.x), 0, dims.x - 1);
+    int y = clamp(int((ndc.y*0.5 + 0.5)*cluster_dims.y), 0, dims.y - 1);
+    int z = clamp(int(floor(log(-position_interp.z)*slice_params.x + slice_params.y)), 0, dims.z - 1);
+
+    vec4 cluster = texelFetch(cluster_tex, ivec2(x + y*dims.x, z), 0);
+    int offset = int(cluster.x);
+    int count = int(cluster.y);
+    ivec2 index_size = textureSize(light_index_tex, 0);
+
+    for (int i = 0; i < count; i++){
+        int k = offset + i;
+        int t = k / 4;
+        int light = int(texelFetch(light_index_tex, ivec2(t % index_size.x, t / index_size.x), 0)[k % 4]);
+
+        vec4 pos_radius = texelFetch(light_tex, ivec2(0, light), 0);
+        vec3 colour = texelFetch(light_tex, ivec2(1, light), 0).rgb;
+
+        vec3 L = pos_radius.xyz - position_interp;
+        float dist = length(L);
+        L /= dist;
+        float atten = clamp(1.0 - dist / pos_radius.w, 0.0, 1.0);
+        atten *= atten;
+
+        diffuse += atten*max(dot(N, L), 0.0)*colour;
+        specular += atten*pow(max(dot(N, normalize(V + L)), 0.0), phong_exponent)*colour;
+    }
+}
+#endif
+
 
 void main() 
 {
@@ -42,6 +90,13 @@ void main()
 	    
 	// Assign light to the fragment based on object's colour
 	gl_FragColor = (ambient_amount + Id)*colour_interp + Is*specular_colour;
+
+#ifndef UNCLUSTERED
+	// Add the dynamic lights of the fragment's cluster
+	vec3 cluster_diffuse, cluster_specular;
+	cluster_lighting(N, V, cluster_diffuse, cluster_specular);
+	gl_FragColor.rgb += cluster_diffuse*colour_interp.rgb + cluster_specular*specular_colour.rgb;
+#endif
 	    
 	// For debug, we can display the different values
 	//gl_FragColor = vec4(ambient_color, 1.0);
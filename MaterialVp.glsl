@@ -23,7 +23,7 @@ void main()
 {
     gl_Position = projection_mat * view_mat * world_mat * vec4(vertex, 1.0);
 
-    position_interp = vec3(view_mat * world_mat * vec4(vertex, 3.0));
+    position_interp = vec3(view_mat * world_mat * vec4(vertex, 1.0));
 	
 	normal_interp = vec3(normal_mat * vec4(normal, 0.0));
 
@@ -0,0 +1,16 @@
+#version 400
+
+// Attributes passed from the vertex shader
+in vec4 colour_interp;
+in vec2 uv_interp;
+
+
+void main() 
+{
+    // Round particle with a soft edge
+    float dist = length(uv_interp*2.0 - vec2(1.0));
+    float intensity = clamp(1.0 - dist, 0.0, 1.0);
+
+	// Blending is additive, so the colour alone controls the brightness
+	gl_FragColor = vec4(colour_interp.rgb*intensity, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,26 @@
+#version 400
+
+// Attributes passed automatically by OGRE
+in vec3 vertex;
+in vec4 colour;
+in vec2 uv0;
+
+// Attributes passed with the material file
+uniform mat4 world_mat;
+uniform mat4 view_mat;
+uniform mat4 projection_mat;
+
+// Attributes forwarded to the fragment shader
+out vec4 colour_interp;
+out vec2 uv_interp;
+
+
+void main()
+{
+    // Quads are built in world coordinates on the CPU
+    gl_Position = projection_mat * view_mat * world_mat * vec4(vertex, 1.0);
+
+	colour_interp = colour;
+
+	uv_interp = uv0;
+}
\ No newline at end of file
@@ -0,0 +1,127 @@
+#include <fstream>
+#include <cstdlib>
+
+#include "OGRE/OgreLogManager.h"
+#include "OGRE/OgreStringConverter.h"
+
+#include "action_table.h"
+
+namespace ogre_application {
+
+/* Names used in binding files, in the order of Action */
+static const char* const action_name_g[NUM_ACTIONS] = {
+	"pitch_up", "pitch_down", "yaw_left", "yaw_right", "roll_left", "roll_right",
+	"thrust_forward", "thrust_backward", "thrust_up", "thrust_down", "thrust_left", "thrust_right",
+	"fire", "reset", "pause", "toggle_hud", "save_field", "quit"
+};
+
+
+ActionTable::ActionTable(void){
+
+	SetDefaults();
+}
+
+
+void ActionTable::SetDefaults(void){
+
+	for (int key = 0; key < NUM_KEY_CODES; key++){
+		action_[key] = NO_ACTION;
+	}
+	Bind(OIS::KC_UP, ActionPitchUp);
+	Bind(OIS::KC_DOWN, ActionPitchDown);
+	Bind(OIS::KC_LEFT, ActionYawLeft);
+	Bind(OIS::KC_RIGHT, ActionYawRight);
+	Bind(OIS::KC_S, ActionRollLeft);
+	Bind(OIS::KC_X, ActionRollRight);
+	Bind(OIS::KC_A, ActionThrustForward);
+	Bind(OIS::KC_Z, ActionThrustBackward);
+	Bind(OIS::KC_PGUP, ActionThrustUp);
+	Bind(OIS::KC_PGDOWN, ActionThrustDown);
+	Bind(OIS::KC_COMMA, ActionThrustLeft);
+	Bind(OIS::KC_PERIOD, ActionThrustRight);
+	Bind(OIS::KC_V, ActionFire);
+	Bind(OIS::KC_R, ActionReset);
+	Bind(OIS::KC_SPACE, ActionPause);
+	Bind(OIS::KC_F1, ActionToggleHud);
+	Bind(OIS::KC_F5, ActionSaveField);
+	Bind(OIS::KC_ESCAPE, ActionQuit);
+}
+
+
+const char* ActionTable::GetActionName(Action action){
+
+	return action_name_g[action];
+}
+
+
+bool ActionTable::Load(const Ogre::String& filename, OIS::Keyboard* keyboard){
+
+	std::ifstream file(filename.c_str());
+	if (!file.is_open()){
+		return false;
+	}
+
+	int action[NUM_KEY_CODES];
+	for (int key = 0; key < NUM_KEY_CODES; key++){
+		action[key] = NO_ACTION;
+	}
+
+	Ogre::String line;
+	int line_number = 0;
+	while (std::getline(file, line)){
+		line_number++;
+		size_t comment = line.find('#');
+		if (comment != Ogre::String::npos){
+			line.erase(comment);
+		}
+		Ogre::StringUtil::trim(line);
+		if (line.empty()){
+			continue;
+		}
+
+		/* Action name and key */
+		size_t equals = line.find('=');
+		Ogre::String name = line.substr(0, equals);
+		Ogre::String key_name = (equals == Ogre::String::npos) ? "" : line.substr(equals + 1);
+		Ogre::StringUtil::trim(name);
+		Ogre::StringUtil::trim(key_name);
+
+		int bound = NO_ACTION;
+		for (int a = 0; a < NUM_ACTIONS; a++){
+			if (name == action_name_g[a]){
+				bound = a;
+			}
+		}
+
+		int key = -1;
+		char* end;
+		long code = strtol(key_name.c_str(), &end, 10);
+		if (!key_name.empty() && (*end == '\0')){
+			key = (int) code;
+		} else {
+			Ogre::String lower_name = key_name;
+			Ogre::StringUtil::toLowerCase(lower_name);
+			for (int k = 1; (k < NUM_KEY_CODES) && (key < 0); k++){
+				Ogre::String spelling = keyboard->getAsString((OIS::KeyCode) k);
+				Ogre::StringUtil::toLowerCase(spelling);
+				if (!lower_name.empty() && (spelling == lower_name)){
+					key = k;
+				}
+			}
+		}
+
+		if ((bound == NO_ACTION) || (key < 0) || (key >= NUM_KEY_CODES)){
+			Ogre::LogManager::getSingleton().logMessage(filename + ":" + Ogre::StringConverter::toString(line_number)
+				+ ": ignoring binding \"" + line + "\"");
+			continue;
+		}
+		action[key] = bound;
+	}
+
+	for (int key = 0; key < NUM_KEY_CODES; key++){
+		action_[key] = action[key];
+	}
+	return true;
+}
+
+} // namespace ogre_application;
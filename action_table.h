@@ -0,0 +1,60 @@
+#ifndef ACTION_TABLE_H_
+#define ACTION_TABLE_H_
+
+#include "OGRE/OgreString.h"
+#include "OIS/OIS.h"
+
+namespace ogre_application {
+
+	#define NUM_KEY_CODES 256 // OIS key codes are scan codes below this
+	#define NO_ACTION -1
+
+	/* What the player can do */
+	enum Action {
+		ActionPitchUp,
+		ActionPitchDown,
+		ActionYawLeft,
+		ActionYawRight,
+		ActionRollLeft,
+		ActionRollRight,
+		ActionThrustForward,
+		ActionThrustBackward,
+		ActionThrustUp,
+		ActionThrustDown,
+		ActionThrustLeft,
+		ActionThrustRight,
+		ActionFire,
+		ActionReset,
+		ActionPause,
+		ActionToggleHud,
+		ActionSaveField,
+		ActionQuit,
+		NUM_ACTIONS
+	};
+
+	/* Keys bound to actions; a key has at most one action, an action any number of keys */
+	class ActionTable {
+
+		public:
+			ActionTable(void);
+
+			/* The controls the demo has always had */
+			void SetDefaults(void);
+
+			/* Replace the bindings with those of a file of lines "action = key", where key
+			   is an OIS key code or a key name as the keyboard spells it and # starts a
+			   comment; returns false and keeps the bindings if the file cannot be read */
+			bool Load(const Ogre::String& filename, OIS::Keyboard* keyboard);
+
+			void Bind(OIS::KeyCode key, Action action) { action_[key] = action; }
+			int GetAction(int key) const { return ((key >= 0) && (key < NUM_KEY_CODES)) ? action_[key] : NO_ACTION; }
+			static const char* GetActionName(Action action);
+
+		private:
+			int action_[NUM_KEY_CODES]; // Action of each key or NO_ACTION
+
+	}; // class ActionTable
+
+} // namespace ogre_application;
+
+#endif // ACTION_TABLE_H_
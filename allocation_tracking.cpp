@@ -0,0 +1,386 @@
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <atomic>
+#if defined(_WIN32)
+#include <windows.h>
+#include <crtdbg.h>
+#endif
+
+#include "allocation_tracking.h"
+
+namespace ogre_application {
+
+/* Counters of a tag; statics start at zero before any constructor runs, so
+   allocations made during static initialisation are counted too */
+struct TagCounters {
+	std::atomic<long long> live_bytes;
+	std::atomic<long long> live_blocks;
+	std::atomic<long long> allocations;
+	std::atomic<long long> frame_bytes; // Frame in progress
+	std::atomic<long long> frame_allocations;
+	std::atomic<long long> last_frame_bytes; // Last complete frame
+	std::atomic<long long> last_frame_allocations;
+};
+
+static TagCounters tag_counters_g[NUM_ALLOCATION_TAGS];
+static std::atomic<int> allocation_check_g;
+static std::atomic<long long> flagged_allocations_g;
+static thread_local int allocation_tag_t = AllocGeneral;
+static thread_local int no_allocation_depth_t = 0;
+static thread_local bool reporting_t = false; // Guards against allocations made while reporting one
+
+static const char* const tag_name_g[NUM_ALLOCATION_TAGS] = {
+	"general", "field", "culling", "lights", "particles", "capture", "hud", "frame arena"
+};
+
+
+static void FlagAllocation(size_t size, int tag){
+
+	if (reporting_t){
+		return;
+	}
+	reporting_t = true;
+	flagged_allocations_g++;
+	fprintf(stderr, "Heap allocation of %lu bytes in the frame loop (%s)\n", (unsigned long) size, tag_name_g[tag]);
+	if (allocation_check_g == AllocationCheckFatal){
+		abort();
+	}
+	reporting_t = false;
+}
+
+
+static void CountAllocation(size_t size, int tag){
+
+	TagCounters& counters = tag_counters_g[tag];
+	counters.live_bytes.fetch_add(size, std::memory_order_relaxed);
+	counters.live_blocks.fetch_add(1, std::memory_order_relaxed);
+	counters.allocations.fetch_add(1, std::memory_order_relaxed);
+	counters.frame_bytes.fetch_add(size, std::memory_order_relaxed);
+	counters.frame_allocations.fetch_add(1, std::memory_order_relaxed);
+
+	if ((no_allocation_depth_t > 0) && (allocation_check_g != AllocationCheckOff)){
+		FlagAllocation(size, tag);
+	}
+}
+
+
+/* Frees are charged to the tag of the allocation, whichever thread makes them */
+static void CountFree(size_t size, int tag){
+
+	TagCounters& counters = tag_counters_g[tag];
+	counters.live_bytes.fetch_sub(size, std::memory_order_relaxed);
+	counters.live_blocks.fetch_sub(1, std::memory_order_relaxed);
+}
+
+
+#if !defined(_WIN32)
+
+/* Elsewhere the global allocation functions are replaced, which every shared
+   library of the process reaches as well. The size and tag of a block are kept
+   in a header placed in front of it; 16 bytes keep the block aligned as malloc() does */
+union BlockHeader {
+	struct {
+		size_t size;
+		int tag;
+	} info;
+	double align[2];
+};
+
+
+static void* TrackedAllocate(size_t size){
+
+	BlockHeader* header = (BlockHeader*) malloc(sizeof(BlockHeader) + size);
+	if (header == NULL){
+		return NULL;
+	}
+	int tag = allocation_tag_t;
+	header->info.size = size;
+	header->info.tag = tag;
+	CountAllocation(size, tag);
+	return header + 1;
+}
+
+
+static void TrackedFree(void* block){
+
+	if (block == NULL){
+		return;
+	}
+	BlockHeader* header = (BlockHeader*) block - 1;
+	CountFree(header->info.size, header->info.tag);
+	free(header);
+}
+
+#elif defined(_DEBUG)
+
+/* On Windows each DLL keeps the operators of its own runtime, so replacing them
+   would not see what OGRE and OIS allocate, and blocks would cross between
+   allocators. The debug runtime, which the executable and the debug DLLs share,
+   instead reports every heap operation to a hook. Blocks carry no tag there, so
+   the tags of live blocks are kept in a table keyed by the request number the
+   runtime gives each block; a block that finds no room in the table is charged
+   to the general tag, both when it is allocated and when it is freed */
+#define TAG_TABLE_SIZE (1 << 20) // Live blocks that can keep their tag; a power of two
+#define MAX_TAG_PROBES 64 // Slots searched from the home slot of a request
+
+struct TagEntry {
+	long request; // Zero for an empty slot; the runtime numbers requests from one
+	int tag;
+};
+
+static TagEntry tag_table_g[TAG_TABLE_SIZE];
+static std::atomic_flag tag_table_lock_g = ATOMIC_FLAG_INIT; // Taking it never allocates
+
+
+static void LockTagTable(void){
+
+	while (tag_table_lock_g.test_and_set(std::memory_order_acquire)){
+	}
+}
+
+
+static void UnlockTagTable(void){
+
+	tag_table_lock_g.clear(std::memory_order_release);
+}
+
+
+static unsigned int TagSlot(long request){
+
+	return ((unsigned int) request * 2654435761u) & (TAG_TABLE_SIZE - 1);
+}
+
+
+/* Returns the tag the block is charged to */
+static int InsertTag(long request, int tag){
+
+	LockTagTable();
+	unsigned int slot = TagSlot(request);
+	for (int probe = 0; probe < MAX_TAG_PROBES; probe++){
+		if (tag_table_g[slot].request == 0){
+			tag_table_g[slot].request = request;
+			tag_table_g[slot].tag = tag;
+			UnlockTagTable();
+			return tag;
+		}
+		slot = (slot + 1) & (TAG_TABLE_SIZE - 1);
+	}
+	UnlockTagTable();
+	return AllocGeneral;
+}
+
+
+/* Returns the tag the block was charged to */
+static int RemoveTag(long request){
+
+	LockTagTable();
+	unsigned int slot = TagSlot(request);
+	int probe = 0;
+	while ((probe < MAX_TAG_PROBES) && (tag_table_g[slot].request != 0) && (tag_table_g[slot].request != request)){
+		slot = (slot + 1) & (TAG_TABLE_SIZE - 1);
+		probe++;
+	}
+	if ((probe == MAX_TAG_PROBES) || (tag_table_g[slot].request != request)){
+		UnlockTagTable();
+		return AllocGeneral;
+	}
+	int tag = tag_table_g[slot].tag;
+
+	/* Close the gap, so that lookups of the entries after it do not stop there; an
+	   entry moves back into the hole unless its home slot lies between the two */
+	unsigned int hole = slot;
+	unsigned int next = (slot + 1) & (TAG_TABLE_SIZE - 1);
+	while (tag_table_g[next].request != 0){
+		unsigned int home = TagSlot(tag_table_g[next].request);
+		if (((next - home) & (TAG_TABLE_SIZE - 1)) >= ((next - hole) & (TAG_TABLE_SIZE - 1))){
+			tag_table_g[hole] = tag_table_g[next];
+			hole = next;
+		}
+		next = (next + 1) & (TAG_TABLE_SIZE - 1);
+	}
+	tag_table_g[hole].request = 0;
+	UnlockTagTable();
+	return tag;
+}
+
+
+/* Called by the debug runtime before it allocates, reallocates or frees a block */
+static int __cdecl AllocationHook(int type, void* block, size_t size, int block_use, long request, const unsigned char* filename, int line){
+
+	/* Blocks of the runtime itself are not the program's */
+	if (_BLOCK_TYPE(block_use) == _CRT_BLOCK){
+		return TRUE;
+	}
+
+	if (((type == _HOOK_FREE) || (type == _HOOK_REALLOC)) && (block != NULL)){
+		size_t block_size = _msize_dbg(block, _BLOCK_TYPE(block_use));
+		long block_request = 0;
+		if (_CrtIsMemoryBlock(block, (unsigned int) block_size, &block_request, NULL, NULL)){
+			CountFree(block_size, RemoveTag(block_request));
+		}
+	}
+	if ((type == _HOOK_ALLOC) || (type == _HOOK_REALLOC)){
+		CountAllocation(size, InsertTag(request, allocation_tag_t));
+	}
+	return TRUE;
+}
+
+/* Installed before main() runs */
+static _CRT_ALLOC_HOOK previous_allocation_hook_g = _CrtSetAllocHook(AllocationHook);
+
+#endif
+
+
+AllocationStats GetAllocationStats(AllocationTag tag){
+
+	const TagCounters& counters = tag_counters_g[tag];
+	AllocationStats stats;
+	stats.live_bytes = counters.live_bytes;
+	stats.live_blocks = counters.live_blocks;
+	stats.allocations = counters.allocations;
+	stats.frame_bytes = counters.last_frame_bytes;
+	stats.frame_allocations = counters.last_frame_allocations;
+	return stats;
+}
+
+
+bool IsAllocationTrackingAvailable(void){
+
+#if defined(_WIN32) && !defined(_DEBUG)
+	return false;
+#else
+	return true;
+#endif
+}
+
+
+const char* GetAllocationTagName(AllocationTag tag){
+
+	return tag_name_g[tag];
+}
+
+
+void NextAllocationFrame(void){
+
+	for (int tag = 0; tag < NUM_ALLOCATION_TAGS; tag++){
+		TagCounters& counters = tag_counters_g[tag];
+		counters.last_frame_bytes = counters.frame_bytes.exchange(0);
+		counters.last_frame_allocations = counters.frame_allocations.exchange(0);
+	}
+}
+
+
+void SetAllocationCheck(AllocationCheck check){
+
+	allocation_check_g = check;
+}
+
+
+long long GetFlaggedAllocations(void){
+
+	return flagged_allocations_g;
+}
+
+
+AllocationScope::AllocationScope(AllocationTag tag){
+
+	previous_tag_ = allocation_tag_t;
+	allocation_tag_t = tag;
+}
+
+
+AllocationScope::~AllocationScope(void){
+
+	allocation_tag_t = previous_tag_;
+}
+
+
+NoAllocationScope::NoAllocationScope(bool active){
+
+	active_ = active;
+	if (active_){
+		no_allocation_depth_t++;
+	}
+}
+
+
+NoAllocationScope::~NoAllocationScope(void){
+
+	if (active_){
+		no_allocation_depth_t--;
+	}
+}
+
+
+AllowAllocationScope::AllowAllocationScope(void){
+
+	previous_depth_ = no_allocation_depth_t;
+	no_allocation_depth_t = 0;
+}
+
+
+AllowAllocationScope::~AllowAllocationScope(void){
+
+	no_allocation_depth_t = previous_depth_;
+}
+
+} // namespace ogre_application;
+
+
+#if !defined(_WIN32)
+
+/* Replacements of the global allocation functions; the array and nothrow forms
+   share the same bookkeeping */
+void* operator new(size_t size){
+
+	void* block = ogre_application::TrackedAllocate(size);
+	if (block == NULL){
+		throw std::bad_alloc();
+	}
+	return block;
+}
+
+
+void* operator new[](size_t size){
+
+	return operator new(size);
+}
+
+
+void* operator new(size_t size, const std::nothrow_t&) throw(){
+
+	return ogre_application::TrackedAllocate(size);
+}
+
+
+void* operator new[](size_t size, const std::nothrow_t&) throw(){
+
+	return ogre_application::TrackedAllocate(size);
+}
+
+
+void operator delete(void* block) throw(){
+
+	ogre_application::TrackedFree(block);
+}
+
+
+void operator delete[](void* block) throw(){
+
+	ogre_application::TrackedFree(block);
+}
+
+
+void operator delete(void* block, const std::nothrow_t&) throw(){
+
+	ogre_application::TrackedFree(block);
+}
+
+
+void operator delete[](void* block, const std::nothrow_t&) throw(){
+
+	ogre_application::TrackedFree(block);
+}
+
+#endif // !defined(_WIN32)
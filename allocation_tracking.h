@@ -0,0 +1,90 @@
+#ifndef ALLOCATION_TRACKING_H_
+#define ALLOCATION_TRACKING_H_
+
+namespace ogre_application {
+
+	/* Subsystems that heap allocations are charged to */
+	enum AllocationTag {
+		AllocGeneral, // Anything outside a scope below
+		AllocField, // Asteroid records, compact state, sorting and the collision grid
+		AllocCulling,
+		AllocLights,
+		AllocParticles,
+		AllocCapture,
+		AllocHud,
+		AllocFrameArena,
+		NUM_ALLOCATION_TAGS
+	};
+
+	/* What happens to a heap allocation made under a NoAllocationScope */
+	enum AllocationCheck {
+		AllocationCheckOff,
+		AllocationCheckReport, // Print it to stderr and count it
+		AllocationCheckFatal // Print it and abort, so a debugger stops at the caller
+	};
+
+	/* Counters of one subsystem */
+	struct AllocationStats {
+		long long live_bytes; // Allocated and not freed yet
+		long long live_blocks;
+		long long allocations; // Since the program started
+		long long frame_bytes; // Allocated during the last complete frame
+		long long frame_allocations;
+	};
+
+	/* Every operator new and delete of the program is counted, against the tag of the
+	   calling thread. Memory from malloc() or from OGRE's own allocators is not seen.
+	   On Windows the debug runtime reports the heap operations instead, malloc()
+	   included; builds with the release runtime track nothing */
+	bool IsAllocationTrackingAvailable(void);
+	AllocationStats GetAllocationStats(AllocationTag tag);
+	const char* GetAllocationTagName(AllocationTag tag);
+
+	/* Close the current frame; its counts become the frame counts of the stats */
+	void NextAllocationFrame(void);
+
+	void SetAllocationCheck(AllocationCheck check);
+	long long GetFlaggedAllocations(void); // Allocations caught by the check so far
+
+	/* Charges the allocations of the calling thread to a tag while it exists */
+	class AllocationScope {
+
+		public:
+			AllocationScope(AllocationTag tag);
+			~AllocationScope(void);
+
+		private:
+			int previous_tag_;
+
+	}; // class AllocationScope
+
+	/* Marks code of the calling thread that must not allocate from the heap once the
+	   application is in its steady state; inactive scopes are free */
+	class NoAllocationScope {
+
+		public:
+			NoAllocationScope(bool active);
+			~NoAllocationScope(void);
+
+		private:
+			bool active_;
+
+	}; // class NoAllocationScope
+
+	/* Lifts the NoAllocationScopes of the calling thread while it exists, for work
+	   that allocates by design and a bounded number of times; its allocations are
+	   still counted */
+	class AllowAllocationScope {
+
+		public:
+			AllowAllocationScope(void);
+			~AllowAllocationScope(void);
+
+		private:
+			int previous_depth_;
+
+	}; // class AllowAllocationScope
+
+} // namespace ogre_application;
+
+#endif // ALLOCATION_TRACKING_H_
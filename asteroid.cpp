@@ -0,0 +1,59 @@
+#include <cstdlib>
+
+#include "asteroid.h"
+
+namespace ogre_application {
+
+void GenerateAsteroids(Asteroid* asteroid, int count, unsigned int seed){
+
+	srand(seed);
+	for (int i = 0; i < count; i++){
+		asteroid[i].pos = Ogre::Vector3(-300 + 600 * (rand() % 1000) / 1000.0f, -300 + 600 * (rand() % 1000) / 1000.0f, 600 * (rand() % 1000) / 1000.0f);
+		asteroid[i].ori = Ogre::Quaternion(1.0f, 3.14*(rand() % 1000) / 1000.0f, 3.14*(rand() % 1000) / 1000.0f, 3.14*(rand() % 1000) / 1000.0f);
+		asteroid[i].lm = Ogre::Quaternion(1.0f, 0.005*3.14*(rand() % 1000) / 1000.0f, 0.005*3.14*(rand() % 1000) / 1000.0f, 0.005*3.14*(rand() % 1000) / 1000.0f);
+		asteroid[i].drift = Ogre::Vector3(((double) rand() / RAND_MAX)*0.2, ((double) rand() / RAND_MAX)*0.2, ((double) rand() / RAND_MAX)*0.2);
+		asteroid[i].alive = true;
+	}
+}
+
+
+void BuildAsteroidMesh(AsteroidVertex* vertex, int* index){
+
+	/* Vertices of an icosahedron */
+	#define X 0.525731112119133606
+	#define Z 0.850650808352039932
+	static float vdata[12][3] = {
+		{-X, 0.0, Z}, {X, 0.0, Z}, {-X, 0.0, -Z}, {X, 0.0, -Z},
+		{0.0, Z, X}, {0.0, Z, -X}, {0.0, -Z, X}, {0.0, -Z, -X},
+		{Z, X, 0.0}, {-Z, X, 0.0}, {Z, -X, 0.0}, {-Z, -X, 0.0}};
+	#undef X
+	#undef Z
+
+	/* Vertex colors */
+	static float clr[12][3] = {
+		{1.0, 0.0, 0.0}, {0.0, 1.0, 0.0}, {0.0, 0.0, 1.0}, {1.0, 1.0, 0.0},
+		{1.0, 0.0, 1.0}, {0.0, 1.0, 1.0}, {1.0, 1.0, 1.0}, {0.6, 0.4, 0.2},
+		{1.0, 0.2, 0.8}, {1.0, 0.4, 0.0}, {0.0, 0.6, 0.0}, {0.6, 0.6, 0.6}};
+
+	/* Faces */
+	static int tindices [20][3] = {
+		{1, 4, 0}, {4, 9, 0}, {4, 5, 9}, {8, 5, 4},	{1, 8, 4},
+		{1, 10, 8}, {10, 3, 8}, {8, 3, 5}, {3, 2, 5}, {3, 7, 2},
+		{3, 10, 7}, {10, 6, 7}, {6, 11, 7}, {6, 0, 11},	{6, 1, 0},
+		{10, 1, 6}, {11, 0, 9}, {2, 11, 9}, {5, 2, 9}, {11, 2, 7},
+	};
+
+	/* The vertices are on the unit sphere, so they are also the normals */
+	for (int i = 0; i < ASTEROID_MESH_VERTICES; i++){
+		vertex[i].position = Ogre::Vector3(vdata[i][0], vdata[i][1], vdata[i][2]);
+		vertex[i].normal = vertex[i].position;
+		vertex[i].colour = Ogre::ColourValue(clr[i][0], clr[i][1], clr[i][2]);
+	}
+	for (int i = 0; i < ASTEROID_MESH_TRIANGLES; i++){
+		index[3*i] = tindices[i][0];
+		index[3*i + 1] = tindices[i][1];
+		index[3*i + 2] = tindices[i][2];
+	}
+}
+
+} // namespace ogre_application;
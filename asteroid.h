@@ -0,0 +1,64 @@
+#ifndef ASTEROID_H_
+#define ASTEROID_H_
+
+#include "OGRE/OgreVector3.h"
+#include "OGRE/OgreQuaternion.h"
+#include "OGRE/OgreCamera.h"
+#include "OGRE/OgreColourValue.h"
+
+namespace ogre_application {
+
+	#define ASTEROID_RADIUS 1.0f // Bounding radius of the asteroid mesh
+	#define ASTEROID_MESH_VERTICES 12 // The mesh is an icosahedron
+	#define ASTEROID_MESH_TRIANGLES 20
+
+	/* An asteroid */
+    struct Asteroid {
+        Ogre::Vector3 pos; // Position
+        Ogre::Quaternion ori; // Orientation
+        Ogre::Quaternion lm; // Angular momentum (use as velocity)
+		Ogre::Vector3 drift; // Drift direction
+		bool alive; // Whether the asteroid was not destroyed yet
+    };
+
+	/* Vertex of the asteroid mesh */
+	struct AsteroidVertex {
+		Ogre::Vector3 position;
+		Ogre::Vector3 normal;
+		Ogre::ColourValue colour;
+	};
+
+	/* Fill count asteroids with a random field; the same seed gives the same field */
+	void GenerateAsteroids(Asteroid* asteroid, int count, unsigned int seed);
+
+	/* The mesh every asteroid is drawn with, in its own coordinates: ASTEROID_MESH_VERTICES
+	   vertices, and three indices into them for each of ASTEROID_MESH_TRIANGLES triangles */
+	void BuildAsteroidMesh(AsteroidVertex* vertex, int* index);
+
+	/* The per-asteroid work of the frame update and of the laser, shared with the
+	   benchmarks so that they time the code the application runs; inline, as they
+	   are called once per asteroid */
+
+	/* Turn the asteroid by its angular momentum, one frame's worth */
+	inline void SpinAsteroid(Asteroid& asteroid){
+
+		asteroid.ori = asteroid.lm * asteroid.ori;
+	}
+
+	inline bool IsAsteroidInView(const Asteroid& asteroid, const Ogre::Camera* camera){
+
+		return camera->isVisible(Ogre::Sphere(asteroid.pos, ASTEROID_RADIUS));
+	}
+
+	/* Whether a ray from origin along the unit direction passes through the asteroid
+	   ahead of the origin */
+	inline bool RayHitsAsteroid(const Asteroid& asteroid, const Ogre::Vector3& origin, const Ogre::Vector3& direction){
+
+		Ogre::Vector3 dir = asteroid.pos - origin;
+		float along = direction.dotProduct(dir);
+		return (along > 0) && (along*along - dir.squaredLength() + ASTEROID_RADIUS*ASTEROID_RADIUS > 0);
+	}
+
+} // namespace ogre_application;
+
+#endif // ASTEROID_H_
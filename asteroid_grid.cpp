@@ -0,0 +1,171 @@
+#include <cmath>
+#include <algorithm>
+
+#include "asteroid_grid.h"
+
+namespace ogre_application {
+
+AsteroidGrid::AsteroidGrid(void){
+
+	min_ = Ogre::Vector3::ZERO;
+	cell_size_ = 1.0f;
+	dim_[0] = dim_[1] = dim_[2] = 0;
+	query_ = 0;
+}
+
+
+void AsteroidGrid::Build(const Asteroid* asteroid, int count, float cell_size){
+
+	cell_start_.clear();
+	cell_item_.clear();
+	stamp_.assign(count, 0);
+	query_ = 0;
+	dim_[0] = dim_[1] = dim_[2] = 0;
+	if (count == 0){
+		return;
+	}
+
+	Ogre::Vector3 max = asteroid[0].pos;
+	min_ = asteroid[0].pos;
+	for (int i = 1; i < count; i++){
+		min_.makeFloor(asteroid[i].pos);
+		max.makeCeil(asteroid[i].pos);
+	}
+
+	/* Larger cells when the field would need too many */
+	Ogre::Vector3 extent = max - min_;
+	float max_extent = std::max(extent.x, std::max(extent.y, extent.z));
+	cell_size_ = std::max(cell_size, max_extent / (GRID_MAX_DIM - 1));
+	for (int axis = 0; axis < 3; axis++){
+		dim_[axis] = std::min(GRID_MAX_DIM, (int) (extent[axis] / cell_size_) + 1);
+	}
+
+	/* Counting sort of the asteroids by cell */
+	int num_cells = dim_[0] * dim_[1] * dim_[2];
+	cell_.resize(count);
+	cell_start_.assign(num_cells + 1, 0);
+	for (int i = 0; i < count; i++){
+		int c[3];
+		for (int axis = 0; axis < 3; axis++){
+			c[axis] = std::min(dim_[axis] - 1, (int) ((asteroid[i].pos[axis] - min_[axis]) / cell_size_));
+		}
+		cell_[i] = (c[2]*dim_[1] + c[1])*dim_[0] + c[0];
+		cell_start_[cell_[i] + 1]++;
+	}
+	for (int c = 0; c < num_cells; c++){
+		cell_start_[c + 1] += cell_start_[c];
+	}
+	cell_item_.resize(count);
+	next_.assign(cell_start_.begin(), cell_start_.end() - 1);
+	for (int i = 0; i < count; i++){
+		cell_item_[next_[cell_[i]]++] = i;
+	}
+}
+
+
+bool AsteroidGrid::CellRange(const Ogre::Vector3& box_min, const Ogre::Vector3& box_max, int first[3], int last[3]) const {
+
+	for (int axis = 0; axis < 3; axis++){
+		float low = (box_min[axis] - min_[axis]) / cell_size_;
+		float high = (box_max[axis] - min_[axis]) / cell_size_;
+		if ((high < 0.0f) || (low >= dim_[axis])){
+			return false;
+		}
+		first[axis] = std::max(0, (int) low);
+		last[axis] = std::min(dim_[axis] - 1, (int) high);
+	}
+	return true;
+}
+
+
+bool AsteroidGrid::SweepSphere(const Asteroid* asteroid, const Ogre::Vector3& start, const Ogre::Vector3& end,
+	float radius, float asteroid_radius, ShipContact& contact){
+
+	if (cell_item_.empty()){
+		return false;
+	}
+
+	/* Asteroids are only tested once even if they are in the range of several pieces */
+	query_++;
+	if (query_ == 0){
+		std::fill(stamp_.begin(), stamp_.end(), 0);
+		query_ = 1;
+	}
+
+	/* Spheres of the combined radius around the centres are hit by the centre of the
+	   moving sphere. Long motions are split into pieces of about a cell, so the cells
+	   visited follow the path instead of filling its bounding box */
+	float reach = radius + asteroid_radius;
+	Ogre::Vector3 motion = end - start;
+	float a = motion.squaredLength();
+	int num_pieces = std::max(1, (int) ceil(sqrt(a) / cell_size_));
+	Ogre::Vector3 margin(reach, reach, reach);
+
+	float best_time = 2.0f;
+	int best = -1;
+	for (int piece = 0; piece < num_pieces; piece++){
+		Ogre::Vector3 piece_start = start + motion*((float) piece / num_pieces);
+		Ogre::Vector3 piece_end = start + motion*((float) (piece + 1) / num_pieces);
+		Ogre::Vector3 box_min = piece_start;
+		Ogre::Vector3 box_max = piece_start;
+		box_min.makeFloor(piece_end);
+		box_max.makeCeil(piece_end);
+
+		int first[3], last[3];
+		if (!CellRange(box_min - margin, box_max + margin, first, last)){
+			continue;
+		}
+		for (int z = first[2]; z <= last[2]; z++){
+			for (int y = first[1]; y <= last[1]; y++){
+				int row = (z*dim_[1] + y)*dim_[0];
+				for (int k = cell_start_[row + first[0]]; k < cell_start_[row + last[0] + 1]; k++){
+					int i = cell_item_[k];
+					if ((stamp_[i] == query_) || !asteroid[i].alive){
+						continue;
+					}
+					stamp_[i] = query_;
+
+					/* Smallest t in [0, 1] with |start + t*motion - centre| = reach */
+					Ogre::Vector3 offset = start - asteroid[i].pos;
+					float b = offset.dotProduct(motion);
+					if (b >= 0.0f){
+						continue; // Not moving towards the centre
+					}
+					float c = offset.squaredLength() - reach*reach;
+					float time;
+					if (c <= 0.0f){
+						time = 0.0f;
+					} else {
+						float discriminant = b*b - a*c;
+						if (discriminant < 0.0f){
+							continue;
+						}
+						time = (-b - sqrt(discriminant)) / a;
+					}
+					if ((time <= 1.0f) && (time < best_time)){
+						best_time = time;
+						best = i;
+					}
+				}
+			}
+		}
+
+		/* Later pieces cannot hold an earlier contact */
+		if ((best >= 0) && (best_time*num_pieces <= piece + 1)){
+			break;
+		}
+	}
+	if (best < 0){
+		return false;
+	}
+
+	Ogre::Vector3 centre = start + motion*best_time;
+	contact.index = best;
+	contact.handle = best;
+	contact.time = best_time;
+	contact.normal = (centre - asteroid[best].pos).normalisedCopy();
+	contact.point = asteroid[best].pos + contact.normal*asteroid_radius;
+	return true;
+}
+
+} // namespace ogre_application;
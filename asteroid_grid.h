@@ -0,0 +1,63 @@
+#ifndef ASTEROID_GRID_H_
+#define ASTEROID_GRID_H_
+
+#include <vector>
+
+#include "OGRE/OgreVector3.h"
+
+#include "asteroid.h"
+
+namespace ogre_application {
+
+	#define GRID_MAX_DIM 128 // Cells along each axis at most; the cells grow to fit the field
+	#define GRID_CELL_SIZE 8.0f // Cell size the grid of the field is built with
+	#define SHIP_RADIUS 1.5f // Bounding radius of the ship around the camera, as swept through the grid
+
+	/* Where a moving sphere first touches an asteroid */
+	struct ShipContact {
+		int index; // Index of the asteroid at the time of the contact
+		int handle; // Handle of the asteroid; filled in by the application
+		float time; // Fraction of the motion done when the contact happens
+		Ogre::Vector3 point; // On the surface of the asteroid
+		Ogre::Vector3 normal; // Out of the asteroid, towards the moving sphere
+	};
+
+	/* Uniform grid over the asteroid field for collision queries. Asteroids are
+	   bucketed by their centre, with each cell's asteroids stored contiguously;
+	   the grid is rebuilt whenever the asteroids move or change index */
+	class AsteroidGrid {
+
+		public:
+			AsteroidGrid(void);
+
+			/* Bucket count asteroids in cells of about cell_size */
+			void Build(const Asteroid* asteroid, int count, float cell_size);
+
+			/* Earliest contact of a sphere of the given radius moving from start to end
+			   with an asteroid that is alive, taken as a sphere of asteroid_radius. The
+			   whole motion is tested, so fast spheres cannot pass through asteroids.
+			   Asteroids the sphere already overlaps only count if it moves towards
+			   their centre. Returns false if nothing is hit */
+			bool SweepSphere(const Asteroid* asteroid, const Ogre::Vector3& start, const Ogre::Vector3& end,
+				float radius, float asteroid_radius, ShipContact& contact);
+
+		private:
+			Ogre::Vector3 min_; // Corner of cell (0, 0, 0)
+			float cell_size_;
+			int dim_[3];
+			std::vector<int> cell_start_; // Asteroids of cell c are cell_item_[cell_start_[c], cell_start_[c + 1])
+			std::vector<int> cell_item_;
+			std::vector<unsigned int> stamp_; // Query that last visited each asteroid
+			/* Scratch of Build(), kept so that rebuilding a field of the same size does not allocate */
+			std::vector<int> cell_; // Cell of each asteroid
+			std::vector<int> next_; // Next free slot of each cell
+			unsigned int query_;
+
+			/* Range of cells overlapping a box; false if the box misses the grid */
+			bool CellRange(const Ogre::Vector3& box_min, const Ogre::Vector3& box_max, int first[3], int last[3]) const;
+
+	}; // class AsteroidGrid
+
+} // namespace ogre_application;
+
+#endif // ASTEROID_GRID_H_
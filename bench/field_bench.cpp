@@ -0,0 +1,450 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+#include "OGRE/OgreRoot.h"
+#include "OGRE/OgreLogManager.h"
+#include "OGRE/OgreSceneManager.h"
+#include "OGRE/OgreSceneNode.h"
+#include "OGRE/OgreCamera.h"
+
+#include "../asteroid.h"
+#include "../asteroid_grid.h"
+#include "../compact_field.h"
+#include "../morton_order.h"
+
+/* Micro-benchmarks of the per-frame kernels of the asteroid field at several field sizes */
+/* Options: --output=FILE to write the results as JSON (default bench_results.json),
+   --baseline=FILE to compare against the results of an earlier run,
+   --threshold=PERCENT to fail when a kernel is that much slower than its baseline (default 10),
+   --sizes=N,N,... to choose the field sizes (default 1500,100000,1000000).
+   The exit code is 1 when a kernel is slower than the threshold allows. Builds
+   without optimisation (no NDEBUG) run, but refuse to compare against a baseline */
+
+namespace ogre_application {
+
+#define BENCH_MAX_NAME 64
+#define BENCH_MAX_SCENE_NODES 100000 // Larger scene graphs take most of the run and memory
+#define BENCH_NUM_SWEEPS 1000 // Ship motions swept per run of the broad phase
+#define BENCH_MESH_BATCH 1024 // Asteroids whose vertices are written before the buffer is reused
+
+const double bench_min_time_g = 0.5; // Seconds each kernel runs for at least, at least bench_min_runs_g times
+const int bench_min_runs_g = 3;
+const int bench_max_runs_g = 1000;
+#if defined(NDEBUG)
+const bool bench_optimised_g = true;
+#else
+const bool bench_optimised_g = false; // Results are not compared, see main()
+#endif
+
+/* State shared by the kernels of one field size */
+struct BenchField {
+	std::vector<Asteroid> asteroid;
+	int count;
+	Ogre::Camera* camera;
+	Ogre::SceneManager* scene_manager;
+	CompactField compact;
+	AsteroidGrid grid;
+	std::vector<Ogre::Vector3> sweep_start;
+	std::vector<Ogre::Vector3> sweep_end;
+	std::vector<AsteroidVertex> mesh_batch;
+	int result; // Kernels add to it so the compiler keeps their work
+};
+
+/* One benchmark result */
+struct BenchResult {
+	char name[BENCH_MAX_NAME];
+	int size;
+	double ns; // Best time of one run in nanoseconds
+};
+
+typedef void (*Kernel)(BenchField& field);
+
+
+/* Field generation as CreateAsteroidField() does it */
+static void KernelGenerate(BenchField& field){
+
+	GenerateAsteroids(&field.asteroid[0], field.count, 1);
+}
+
+
+/* Orientation update and visibility test of TransformAsteroidField() */
+static void KernelIntegrate(BenchField& field){
+
+	int visible = 0;
+	for (int i = 0; i < field.count; i++){
+		Asteroid& asteroid = field.asteroid[i];
+		if (!asteroid.alive){
+			continue;
+		}
+		SpinAsteroid(asteroid);
+		if (IsAsteroidInView(asteroid, field.camera)){
+			visible++;
+		}
+	}
+	field.result += visible;
+}
+
+
+/* The same update from the compact state */
+static void KernelIntegrateCompact(BenchField& field){
+
+	field.result += field.compact.Cull(field.camera, ASTEROID_RADIUS);
+}
+
+
+/* Laser ray test of collision(), without destroying what it hits */
+static void KernelRay(BenchField& field){
+
+	Ogre::Vector3 l = field.camera->getDirection();
+	Ogre::Vector3 o = field.camera->getPosition();
+	int hits = 0;
+	for (int i = 0; i < field.count; i++){
+		if (!field.asteroid[i].alive){
+			continue;
+		}
+		if (RayHitsAsteroid(field.asteroid[i], o, l)){
+			hits++;
+		}
+	}
+	field.result += hits;
+}
+
+
+static void KernelGridBuild(BenchField& field){
+
+	field.grid.Build(&field.asteroid[0], field.count, GRID_CELL_SIZE);
+}
+
+
+/* Ship motions of MoveShip() swept through the broad phase; the asteroids of a
+   cell are scattered over the array in creation order and next to each other in
+   Morton order, which is what the same kernel shows once the field is sorted */
+static void KernelGridSweep(BenchField& field){
+
+	ShipContact contact;
+	for (int k = 0; k < BENCH_NUM_SWEEPS; k++){
+		if (field.grid.SweepSphere(&field.asteroid[0], field.sweep_start[k], field.sweep_end[k], SHIP_RADIUS, ASTEROID_RADIUS, contact)){
+			field.result++;
+		}
+	}
+}
+
+
+/* Scene nodes for every asteroid, as they are made when the field comes into view;
+   entities are left out as they need a render system */
+static void KernelSceneBuild(BenchField& field){
+
+	Ogre::SceneNode* root_scene_node = field.scene_manager->getRootSceneNode();
+	for (int i = 0; i < field.count; i++){
+		root_scene_node->createChildSceneNode(field.asteroid[i].pos, field.asteroid[i].ori);
+	}
+	root_scene_node->removeAndDestroyAllChildren();
+}
+
+
+/* The asteroid mesh of CreateIcosahedron() placed at every asteroid on the CPU, as
+   a static batch of the field would be built. The vertices go a batch of asteroids
+   at a time into the same buffer, like a ring streamed to the GPU; no render
+   system is needed, so unlike scene_build it runs at every field size */
+static void KernelMeshBuild(BenchField& field){
+
+	AsteroidVertex mesh[ASTEROID_MESH_VERTICES];
+	int index[3*ASTEROID_MESH_TRIANGLES];
+	BuildAsteroidMesh(mesh, index);
+
+	AsteroidVertex* vertex = &field.mesh_batch[0];
+	int num_vertices = 0;
+	for (int i = 0; i < field.count; i++){
+		const Asteroid& asteroid = field.asteroid[i];
+		if (!asteroid.alive){
+			continue;
+		}
+		for (int v = 0; v < ASTEROID_MESH_VERTICES; v++){
+			vertex[num_vertices].position = asteroid.pos + asteroid.ori*mesh[v].position;
+			vertex[num_vertices].normal = asteroid.ori*mesh[v].normal;
+			vertex[num_vertices].colour = mesh[v].colour;
+			num_vertices++;
+		}
+		if (num_vertices == BENCH_MESH_BATCH*ASTEROID_MESH_VERTICES){
+			field.result += (int) vertex[num_vertices - 1].position.x;
+			num_vertices = 0;
+		}
+	}
+	field.result += num_vertices;
+}
+
+
+/* Reorder the field along a Morton curve as SortAsteroids() does, and rebuild the grid */
+static void SortField(BenchField& field){
+
+	Ogre::Vector3 min = field.asteroid[0].pos;
+	Ogre::Vector3 max = field.asteroid[0].pos;
+	for (int i = 1; i < field.count; i++){
+		min.makeFloor(field.asteroid[i].pos);
+		max.makeCeil(field.asteroid[i].pos);
+	}
+	std::vector<unsigned int> code(field.count);
+	for (int i = 0; i < field.count; i++){
+		code[i] = MortonCode(field.asteroid[i].pos, min, max - min);
+	}
+	std::vector<int> order, scratch;
+	SortByMortonCode(code, order, scratch);
+
+	std::vector<Asteroid> sorted(field.count);
+	for (int k = 0; k < field.count; k++){
+		sorted[k] = field.asteroid[order[k]];
+	}
+	field.asteroid.swap(sorted);
+	field.grid.Build(&field.asteroid[0], field.count, GRID_CELL_SIZE);
+}
+
+
+/* Best time of a run in nanoseconds; runs are repeated until enough time has passed */
+static double TimeKernel(Kernel kernel, BenchField& field){
+
+	double best = 0.0;
+	double total = 0.0;
+	for (int run = 0; run < bench_max_runs_g; run++){
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		kernel(field);
+		double ns = std::chrono::duration<double, std::nano>(std::chrono::high_resolution_clock::now() - start).count();
+		if ((run == 0) || (ns < best)){
+			best = ns;
+		}
+		total += ns;
+		if ((run + 1 >= bench_min_runs_g) && (total >= bench_min_time_g*1.0e9)){
+			break;
+		}
+	}
+	return best;
+}
+
+
+static void RunBenchmark(const char* name, Kernel kernel, BenchField& field, std::vector<BenchResult>& results){
+
+	BenchResult result;
+	strncpy(result.name, name, BENCH_MAX_NAME - 1);
+	result.name[BENCH_MAX_NAME - 1] = '\0';
+	result.size = field.count;
+	result.ns = TimeKernel(kernel, field);
+	results.push_back(result);
+	printf("%-18s %8d %14.0f ns %10.2f ns/asteroid\n", name, field.count, result.ns, result.ns / field.count);
+}
+
+
+static void RunSize(int count, Ogre::SceneManager* scene_manager, Ogre::Camera* camera, std::vector<BenchResult>& results){
+
+	BenchField field;
+	field.count = count;
+	field.camera = camera;
+	field.scene_manager = scene_manager;
+	field.result = 0;
+	field.asteroid.resize(count);
+	field.mesh_batch.resize(BENCH_MESH_BATCH*ASTEROID_MESH_VERTICES);
+
+	RunBenchmark("generate", KernelGenerate, field, results);
+
+	/* Later kernels start from the same field */
+	GenerateAsteroids(&field.asteroid[0], count, 1);
+	field.compact.Encode(&field.asteroid[0], count);
+	RunBenchmark("integrate", KernelIntegrate, field, results);
+	RunBenchmark("integrate_compact", KernelIntegrateCompact, field, results);
+	RunBenchmark("laser_ray", KernelRay, field, results);
+	RunBenchmark("grid_build", KernelGridBuild, field, results);
+
+	/* Motions of up to a few hundred units from points in the field, like a ship
+	   at full speed on a slow frame */
+	srand(2);
+	field.sweep_start.resize(BENCH_NUM_SWEEPS);
+	field.sweep_end.resize(BENCH_NUM_SWEEPS);
+	for (int k = 0; k < BENCH_NUM_SWEEPS; k++){
+		Ogre::Vector3 start(-300 + 600 * (rand() % 1000) / 1000.0f, -300 + 600 * (rand() % 1000) / 1000.0f, 600 * (rand() % 1000) / 1000.0f);
+		Ogre::Vector3 motion(rand() % 1000 - 500.0f, rand() % 1000 - 500.0f, rand() % 1000 - 500.0f);
+		field.sweep_start[k] = start;
+		field.sweep_end[k] = start + motion * ((k % 10 == 0) ? 0.5f : 0.02f);
+	}
+	RunBenchmark("grid_sweep", KernelGridSweep, field, results);
+	RunBenchmark("mesh_build", KernelMeshBuild, field, results);
+
+	if (count <= BENCH_MAX_SCENE_NODES){
+		RunBenchmark("scene_build", KernelSceneBuild, field, results);
+	}
+
+	/* The same sweeps once the field is in spatial order */
+	SortField(field);
+	RunBenchmark("grid_sweep_morton", KernelGridSweep, field, results);
+
+	/* Keeps the work of the kernels from being optimised away */
+	if (field.result == -1){
+		printf("\n");
+	}
+}
+
+
+static bool WriteResults(const std::string& filename, const std::vector<BenchResult>& results){
+
+	std::ofstream file(filename.c_str());
+	if (!file.is_open()){
+		return false;
+	}
+
+	/* One result per line, which is what ReadResults() expects */
+	file << "{" << std::endl << "  \"benchmarks\": [" << std::endl;
+	for (size_t i = 0; i < results.size(); i++){
+		char line[256];
+		sprintf(line, "    {\"name\": \"%s\", \"size\": %d, \"ns\": %.1f}%s", results[i].name, results[i].size, results[i].ns,
+			(i + 1 < results.size()) ? "," : "");
+		file << line << std::endl;
+	}
+	file << "  ]" << std::endl << "}" << std::endl;
+	return file.good();
+}
+
+
+static bool ReadResults(const std::string& filename, std::vector<BenchResult>& results){
+
+	std::ifstream file(filename.c_str());
+	if (!file.is_open()){
+		return false;
+	}
+	std::string line;
+	while (std::getline(file, line)){
+		BenchResult result;
+		if (sscanf(line.c_str(), " {\"name\": \"%63[^\"]\", \"size\": %d, \"ns\": %lf", result.name, &result.size, &result.ns) == 3){
+			results.push_back(result);
+		}
+	}
+	return true;
+}
+
+
+/* Returns the number of kernels slower than the baseline by more than threshold percent */
+static int CompareResults(const std::vector<BenchResult>& results, const std::vector<BenchResult>& baseline, double threshold){
+
+	int regressions = 0;
+	printf("\n%-18s %8s %14s %14s %8s\n", "kernel", "size", "baseline ns", "current ns", "change");
+	for (size_t i = 0; i < results.size(); i++){
+		const BenchResult* base = NULL;
+		for (size_t j = 0; j < baseline.size(); j++){
+			if ((strcmp(baseline[j].name, results[i].name) == 0) && (baseline[j].size == results[i].size)){
+				base = &baseline[j];
+				break;
+			}
+		}
+		if (base == NULL){
+			printf("%-18s %8d %14s %14.0f %8s\n", results[i].name, results[i].size, "-", results[i].ns, "new");
+			continue;
+		}
+
+		double change = (results[i].ns / base->ns - 1.0) * 100.0;
+		bool regressed = (change > threshold);
+		printf("%-18s %8d %14.0f %14.0f %+7.1f%%%s\n", results[i].name, results[i].size, base->ns, results[i].ns, change,
+			regressed ? "  SLOWER" : "");
+		if (regressed){
+			regressions++;
+		}
+	}
+	return regressions;
+}
+
+} // namespace ogre_application;
+
+
+int main(int argc, char* argv[]){
+
+	using namespace ogre_application;
+
+	std::string output_filename = "bench_results.json";
+	std::string baseline_filename;
+	double threshold = 10.0;
+	std::vector<int> sizes;
+
+	for (int i = 1; i < argc; i++){
+		if (strncmp(argv[i], "--output=", 9) == 0){
+			output_filename = argv[i] + 9;
+		} else if (strncmp(argv[i], "--baseline=", 11) == 0){
+			baseline_filename = argv[i] + 11;
+		} else if (strncmp(argv[i], "--threshold=", 12) == 0){
+			threshold = atof(argv[i] + 12);
+		} else if (strncmp(argv[i], "--sizes=", 8) == 0){
+			std::istringstream list(argv[i] + 8);
+			std::string size;
+			while (std::getline(list, size, ',')){
+				if (atoi(size.c_str()) > 0){
+					sizes.push_back(atoi(size.c_str()));
+				}
+			}
+		} else {
+			std::cerr << "Unknown option " << argv[i] << std::endl;
+			return 2;
+		}
+	}
+	if (sizes.empty()){
+		sizes.push_back(1500);
+		sizes.push_back(100000);
+		sizes.push_back(1000000);
+	}
+
+	std::vector<BenchResult> results;
+	try {
+		/* A scene manager and a camera work without a render system; the log only
+		   goes to a file */
+		Ogre::LogManager* log_manager = new Ogre::LogManager();
+		log_manager->createLog("bench.log", true, false, false);
+		Ogre::Root* root = new Ogre::Root("", "", "bench.log");
+		Ogre::SceneManager* scene_manager = root->createSceneManager(Ogre::ST_GENERIC, "BenchSceneManager");
+
+		/* The camera as the application starts */
+		Ogre::Camera* camera = scene_manager->createCamera("BenchCamera");
+		camera->setNearClipDistance(0.1);
+		camera->setFarClipDistance(5000.0);
+		camera->setAspectRatio(800.0f / 600.0f);
+		camera->setPosition(Ogre::Vector3(0.0, -10.0, 800.0));
+		camera->lookAt(Ogre::Vector3(0.0, 0.0, 0.0));
+
+		for (size_t i = 0; i < sizes.size(); i++){
+			RunSize(sizes[i], scene_manager, camera, results);
+		}
+
+		delete root;
+		delete log_manager;
+	}
+	catch (Ogre::Exception &e){
+		std::cerr << "Ogre::Exception: " << e.what() << std::endl;
+		return 2;
+	}
+	catch (std::exception &e){
+		std::cerr << "std::Exception: " << e.what() << std::endl;
+		return 2;
+	}
+
+	if (!WriteResults(output_filename, results)){
+		std::cerr << "Could not write " << output_filename << std::endl;
+		return 2;
+	}
+
+	if (!baseline_filename.empty() && !bench_optimised_g){
+		/* The overhead of a debug build would be measured instead of the kernels */
+		std::cerr << "Not comparing against " << baseline_filename << ": the benchmark was built without optimisation" << std::endl;
+		return 2;
+	} else if (!baseline_filename.empty()){
+		std::vector<BenchResult> baseline;
+		if (!ReadResults(baseline_filename, baseline)){
+			std::cerr << "Could not read " << baseline_filename << std::endl;
+			return 2;
+		}
+		int regressions = CompareResults(results, baseline, threshold);
+		if (regressions > 0){
+			printf("%d kernels are more than %.1f%% slower than the baseline\n", regressions, threshold);
+			return 1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,301 @@
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <xmmintrin.h>
+#include <emmintrin.h>
+
+#include "compact_field.h"
+
+namespace ogre_application {
+
+/* Quantisation of a smallest-three component, which lies in [-1/sqrt(2), 1/sqrt(2)] */
+const float orientation_range_g = 0.70710678f;
+const float orientation_steps_g = 1023.0f;
+
+const float two_pi_g = 6.28318531f;
+
+
+/* Map v in [-range, range] to an integer in [0, steps] */
+static unsigned int QuantiseSigned(float v, float range, float steps){
+
+	float t = (v / range * 0.5f + 0.5f) * steps + 0.5f;
+	return (unsigned int) std::max(0.0f, std::min(t, steps));
+}
+
+
+static float DequantiseSigned(unsigned int q, float range, float steps){
+
+	return ((float) q / steps * 2.0f - 1.0f) * range;
+}
+
+
+/* Drop the largest component of the unit quaternion, made positive, and keep the
+   other three in 10 bits each; its index goes into the top two bits */
+static Ogre::uint32 EncodeOrientation(Ogre::Quaternion q){
+
+	q.normalise();
+	int largest = 0;
+	for (int c = 1; c < 4; c++){
+		if (fabs(q[c]) > fabs(q[largest])){
+			largest = c;
+		}
+	}
+	float sign = (q[largest] < 0.0f) ? -1.0f : 1.0f;
+
+	Ogre::uint32 packed = (Ogre::uint32) largest << 30;
+	int shift = 20;
+	for (int c = 0; c < 4; c++){
+		if (c != largest){
+			packed |= QuantiseSigned(sign*q[c], orientation_range_g, orientation_steps_g) << shift;
+			shift -= 10;
+		}
+	}
+	return packed;
+}
+
+
+static Ogre::Quaternion DecodeOrientation(Ogre::uint32 packed){
+
+	int largest = packed >> 30;
+	Ogre::Quaternion q;
+	float sum = 0.0f;
+	int shift = 20;
+	for (int c = 0; c < 4; c++){
+		if (c != largest){
+			q[c] = DequantiseSigned((packed >> shift) & 0x3FF, orientation_range_g, orientation_steps_g);
+			sum += q[c]*q[c];
+			shift -= 10;
+		}
+	}
+	q[largest] = sqrt(std::max(0.0f, 1.0f - sum));
+	return q;
+}
+
+
+/* Unit vector folded onto an octahedron and stored as two bytes */
+static Ogre::uint32 EncodeAxis(const Ogre::Vector3& axis){
+
+	float l1 = fabs(axis.x) + fabs(axis.y) + fabs(axis.z);
+	float u = axis.x / l1;
+	float v = axis.y / l1;
+	if (axis.z < 0.0f){
+		float folded_u = (1.0f - fabs(v)) * ((u < 0.0f) ? -1.0f : 1.0f);
+		v = (1.0f - fabs(u)) * ((v < 0.0f) ? -1.0f : 1.0f);
+		u = folded_u;
+	}
+	return QuantiseSigned(u, 1.0f, 255.0f) | (QuantiseSigned(v, 1.0f, 255.0f) << 8);
+}
+
+
+static Ogre::Vector3 DecodeAxis(Ogre::uint32 packed){
+
+	float u = DequantiseSigned(packed & 0xFF, 1.0f, 255.0f);
+	float v = DequantiseSigned((packed >> 8) & 0xFF, 1.0f, 255.0f);
+	Ogre::Vector3 axis(u, v, 1.0f - fabs(u) - fabs(v));
+	if (axis.z < 0.0f){
+		axis.x = (1.0f - fabs(v)) * ((u < 0.0f) ? -1.0f : 1.0f);
+		axis.y = (1.0f - fabs(u)) * ((v < 0.0f) ? -1.0f : 1.0f);
+	}
+	axis.normalise();
+	return axis;
+}
+
+
+/* Rotation per frame of a spin quaternion; like the scene nodes, only its direction counts */
+static float SpinAngle(Ogre::Quaternion spin, Ogre::Vector3& axis){
+
+	spin.normalise();
+	if (spin.w < 0.0f){
+		spin = -spin;
+	}
+	axis = Ogre::Vector3(spin.x, spin.y, spin.z);
+	float sine = axis.normalise();
+	if (sine < 1e-7f){
+		axis = Ogre::Vector3(0.0f, 0.0f, 1.0f);
+		return 0.0f;
+	}
+	return 2.0f*atan2(sine, spin.w);
+}
+
+
+CompactField::CompactField(void){
+
+	memory_ = NULL;
+	sector_ = NULL;
+	pos_x_ = NULL;
+	pos_y_ = NULL;
+	pos_z_ = NULL;
+	orientation_ = NULL;
+	spin_ = NULL;
+	alive_ = NULL;
+	visible_ = NULL;
+	count_ = 0;
+	max_spin_angle_ = 0.0f;
+}
+
+
+CompactField::~CompactField(void){
+
+	if (memory_ != NULL){
+		_mm_free(memory_);
+	}
+}
+
+
+void CompactField::Encode(const Asteroid* asteroid, int count){
+
+	if (memory_ != NULL){
+		_mm_free(memory_);
+		memory_ = NULL;
+	}
+	count_ = count;
+	if (count == 0){
+		return;
+	}
+
+	/* Padding to 16 asteroids keeps every array 16-byte aligned */
+	size_t padded = (count + 15) & ~15;
+	memory_ = (unsigned char*) _mm_malloc(padded*(4*sizeof(Ogre::uint16) + 2*sizeof(Ogre::uint32) + 2), 16);
+	memset(memory_, 0, padded*(4*sizeof(Ogre::uint16) + 2*sizeof(Ogre::uint32) + 2));
+	sector_ = (Ogre::uint16*) memory_;
+	pos_x_ = sector_ + padded;
+	pos_y_ = pos_x_ + padded;
+	pos_z_ = pos_y_ + padded;
+	orientation_ = (Ogre::uint32*) (pos_z_ + padded);
+	spin_ = orientation_ + padded;
+	alive_ = (unsigned char*) (spin_ + padded);
+	visible_ = alive_ + padded;
+
+	/* Quantisation ranges cover the whole field */
+	Ogre::Vector3 max = asteroid[0].pos;
+	field_min_ = asteroid[0].pos;
+	max_spin_angle_ = 0.0f;
+	for (int i = 0; i < count; i++){
+		field_min_.makeFloor(asteroid[i].pos);
+		max.makeCeil(asteroid[i].pos);
+		Ogre::Vector3 axis;
+		max_spin_angle_ = std::max(max_spin_angle_, SpinAngle(asteroid[i].lm, axis));
+	}
+	for (int c = 0; c < 3; c++){
+		sector_size_[c] = std::max(max[c] - field_min_[c], 1e-3f) * 1.0001f / SECTOR_DIM;
+	}
+
+	for (int i = 0; i < count; i++){
+		Ogre::uint16 sector = 0;
+		Ogre::uint16* pos[3] = {pos_x_, pos_y_, pos_z_};
+		for (int c = 0; c < 3; c++){
+			float cells = (asteroid[i].pos[c] - field_min_[c]) / sector_size_[c];
+			int s = std::min(std::max((int) floor(cells), 0), SECTOR_DIM - 1);
+			float offset = (cells - s) * 65536.0f + 0.5f;
+			pos[c][i] = (Ogre::uint16) std::max(0.0f, std::min(offset, 65535.0f));
+			sector |= s << (c*SECTOR_BITS);
+		}
+		sector_[i] = sector;
+
+		orientation_[i] = EncodeOrientation(asteroid[i].ori);
+
+		Ogre::Vector3 axis;
+		float angle = SpinAngle(asteroid[i].lm, axis);
+		Ogre::uint32 quantised_angle = (max_spin_angle_ > 0.0f) ? (Ogre::uint32) (angle / max_spin_angle_ * 65535.0f + 0.5f) : 0;
+		spin_[i] = quantised_angle | (EncodeAxis(axis) << 16);
+
+		alive_[i] = asteroid[i].alive ? 1 : 0;
+	}
+}
+
+
+Ogre::Vector3 CompactField::GetPosition(int i) const {
+
+	Ogre::uint16 sector = sector_[i];
+	return Ogre::Vector3(
+		field_min_.x + ((sector & (SECTOR_DIM - 1)) + pos_x_[i] / 65536.0f) * sector_size_.x,
+		field_min_.y + (((sector >> SECTOR_BITS) & (SECTOR_DIM - 1)) + pos_y_[i] / 65536.0f) * sector_size_.y,
+		field_min_.z + (((sector >> (2*SECTOR_BITS)) & (SECTOR_DIM - 1)) + pos_z_[i] / 65536.0f) * sector_size_.z);
+}
+
+
+Ogre::Quaternion CompactField::GetOrientation(int i, unsigned long steps) const {
+
+	/* Angles wrap in double precision so long runs keep their accuracy */
+	float angle = (spin_[i] & 0xFFFF) / 65535.0f * max_spin_angle_;
+	double phase = fmod((double) angle * (double) steps, (double) two_pi_g);
+	Ogre::Quaternion rotation(Ogre::Radian((Ogre::Real) phase), DecodeAxis(spin_[i] >> 16));
+	return rotation * DecodeOrientation(orientation_[i]);
+}
+
+
+void CompactField::DecodeOrientations(Asteroid* asteroid, unsigned long steps) const {
+
+	for (int i = 0; i < count_; i++){
+		asteroid[i].ori = GetOrientation(i, steps);
+	}
+}
+
+
+int CompactField::Cull(const Ogre::Camera* camera, float radius){
+
+	/* Planes in world space; an infinite far plane is left out, as OGRE does */
+	int num_planes = 0;
+	__m128 plane_x[6], plane_y[6], plane_z[6], plane_d[6];
+	for (unsigned short p = 0; p < 6; p++){
+		if ((p == Ogre::FRUSTUM_PLANE_FAR) && (camera->getFarClipDistance() == 0)){
+			continue;
+		}
+		const Ogre::Plane& plane = camera->getFrustumPlane(p);
+		plane_x[num_planes] = _mm_set1_ps(plane.normal.x);
+		plane_y[num_planes] = _mm_set1_ps(plane.normal.y);
+		plane_z[num_planes] = _mm_set1_ps(plane.normal.z);
+		plane_d[num_planes] = _mm_set1_ps(plane.d);
+		num_planes++;
+	}
+
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i sector_mask = _mm_set1_epi32(SECTOR_DIM - 1);
+	const __m128 offset_scale = _mm_set1_ps(1.0f / 65536.0f);
+	const __m128 min_x = _mm_set1_ps(field_min_.x);
+	const __m128 min_y = _mm_set1_ps(field_min_.y);
+	const __m128 min_z = _mm_set1_ps(field_min_.z);
+	const __m128 size_x = _mm_set1_ps(sector_size_.x);
+	const __m128 size_y = _mm_set1_ps(sector_size_.y);
+	const __m128 size_z = _mm_set1_ps(sector_size_.z);
+	const __m128 negative_radius = _mm_set1_ps(-radius);
+
+	int num_visible = 0;
+	for (int i = 0; i < count_; i += 4){
+		/* Widen four 16-bit values to 32-bit integers and then to floats */
+		__m128i sector = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*) (sector_ + i)), zero);
+		__m128 sector_x = _mm_cvtepi32_ps(_mm_and_si128(sector, sector_mask));
+		__m128 sector_y = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(sector, SECTOR_BITS), sector_mask));
+		__m128 sector_z = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(sector, 2*SECTOR_BITS), sector_mask));
+		__m128 offset_x = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*) (pos_x_ + i)), zero));
+		__m128 offset_y = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*) (pos_y_ + i)), zero));
+		__m128 offset_z = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*) (pos_z_ + i)), zero));
+		__m128 x = _mm_add_ps(min_x, _mm_mul_ps(_mm_add_ps(sector_x, _mm_mul_ps(offset_x, offset_scale)), size_x));
+		__m128 y = _mm_add_ps(min_y, _mm_mul_ps(_mm_add_ps(sector_y, _mm_mul_ps(offset_y, offset_scale)), size_y));
+		__m128 z = _mm_add_ps(min_z, _mm_mul_ps(_mm_add_ps(sector_z, _mm_mul_ps(offset_z, offset_scale)), size_z));
+
+		/* Outside when entirely behind any plane */
+		__m128 outside = _mm_setzero_ps();
+		for (int p = 0; p < num_planes; p++){
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(plane_x[p], x), _mm_mul_ps(plane_y[p], y)),
+				_mm_add_ps(_mm_mul_ps(plane_z[p], z), plane_d[p]));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, negative_radius));
+		}
+
+		/* Four alive bytes widened to 32-bit lanes */
+		int alive_bytes;
+		memcpy(&alive_bytes, alive_ + i, sizeof(int));
+		__m128i alive = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(alive_bytes), zero), zero);
+		__m128 alive_mask = _mm_castsi128_ps(_mm_cmpgt_epi32(alive, zero));
+
+		int bits = _mm_movemask_ps(_mm_andnot_ps(outside, alive_mask));
+		visible_[i] = bits & 1;
+		visible_[i + 1] = (bits >> 1) & 1;
+		visible_[i + 2] = (bits >> 2) & 1;
+		visible_[i + 3] = (bits >> 3) & 1;
+		num_visible += visible_[i] + visible_[i + 1] + visible_[i + 2] + visible_[i + 3];
+	}
+	return num_visible;
+}
+
+} // namespace ogre_application;
@@ -0,0 +1,70 @@
+#ifndef COMPACT_FIELD_H_
+#define COMPACT_FIELD_H_
+
+#include "OGRE/OgreCamera.h"
+
+#include "asteroid.h"
+
+namespace ogre_application {
+
+	#define SECTOR_BITS 5 // The field is split into 2^SECTOR_BITS sectors along each axis
+	#define SECTOR_DIM (1 << SECTOR_BITS)
+
+	/* Copy of the state the per-frame update needs in a compact structure-of-arrays
+	   layout, 18 bytes per asteroid instead of 60:
+	   - position: a 16-bit sector index and 16-bit offsets within the sector
+	   - orientation at encoding time: smallest three components in 32 bits
+	   - spin: rotation per frame as a 16-bit angle and an octahedral 16-bit axis
+	   - alive and visible flags: a byte each
+	   The orientation after n frames is the spin applied n times, which is computed
+	   directly, so the update writes nothing back and only visible asteroids have
+	   their orientation decoded. Culling decodes positions four at a time with SSE.
+	   Positions are fixed once encoded */
+	class CompactField {
+
+		public:
+			CompactField(void);
+			~CompactField(void);
+
+			/* Encode count asteroids; orientations are taken as those of frame zero */
+			void Encode(const Asteroid* asteroid, int count);
+
+			/* Write the orientations at frame steps back to the full records */
+			void DecodeOrientations(Asteroid* asteroid, unsigned long steps) const;
+
+			int GetCount(void) const { return count_; }
+
+			Ogre::Vector3 GetPosition(int i) const;
+			Ogre::Quaternion GetOrientation(int i, unsigned long steps) const;
+			bool IsAlive(int i) const { return alive_[i] != 0; }
+			void Kill(int i) { alive_[i] = 0; }
+
+			/* Test the living asteroids, as spheres of the given radius, against the view
+			   frustum; returns how many are visible and marks them in GetVisible() */
+			int Cull(const Ogre::Camera* camera, float radius);
+			const unsigned char* GetVisible(void) const { return visible_; }
+
+		private:
+			/* One block of memory for all arrays, each 16-byte aligned and padded to a
+			   multiple of four asteroids; padding asteroids are dead */
+			unsigned char* memory_;
+			Ogre::uint16* sector_; // x, y and z sector in 5 bits each
+			Ogre::uint16* pos_x_; // Offset within the sector in units of 1/65536 of its size
+			Ogre::uint16* pos_y_;
+			Ogre::uint16* pos_z_;
+			Ogre::uint32* orientation_;
+			Ogre::uint32* spin_;
+			unsigned char* alive_;
+			unsigned char* visible_;
+			int count_;
+
+			/* Quantisation ranges */
+			Ogre::Vector3 field_min_;
+			Ogre::Vector3 sector_size_;
+			float max_spin_angle_;
+
+	}; // class CompactField
+
+} // namespace ogre_application;
+
+#endif // COMPACT_FIELD_H_
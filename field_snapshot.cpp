@@ -0,0 +1,201 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "OGRE/OgreLogManager.h"
+
+#include "field_snapshot.h"
+#include "allocation_tracking.h"
+
+namespace ogre_application {
+
+const char snapshot_magic_g[8] = {'A', 'S', 'T', 'F', 'I', 'E', 'L', 'D'};
+
+
+FieldSnapshot::FieldSnapshot(void){
+
+	mapping_ = NULL;
+	mapping_size_ = 0;
+#if defined(_WIN32)
+	file_handle_ = NULL;
+	mapping_handle_ = NULL;
+#endif
+	records_ = NULL;
+	num_records_ = 0;
+	seed_ = 0;
+}
+
+
+FieldSnapshot::~FieldSnapshot(void){
+
+	WaitForSave();
+	Unmap();
+}
+
+
+bool FieldSnapshot::Map(const Ogre::String& filename, size_t record_size){
+
+	Unmap();
+
+	/* Private mapping: the simulation writes to its own copy of the pages it changes */
+#if defined(_WIN32)
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE){
+		return false;
+	}
+	LARGE_INTEGER file_size;
+	GetFileSizeEx(file, &file_size);
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+	if (mapping == NULL){
+		CloseHandle(file);
+		return false;
+	}
+	mapping_ = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+	if (mapping_ == NULL){
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+	file_handle_ = file;
+	mapping_handle_ = mapping;
+	mapping_size_ = (size_t) file_size.QuadPart;
+#else
+	int file = open(filename.c_str(), O_RDONLY);
+	if (file < 0){
+		return false;
+	}
+	struct stat file_stat;
+	if ((fstat(file, &file_stat) != 0) || (file_stat.st_size == 0)){
+		close(file);
+		return false;
+	}
+	void* mapping = mmap(NULL, (size_t) file_stat.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+	close(file); // The mapping keeps the file open
+	if (mapping == MAP_FAILED){
+		return false;
+	}
+	mapping_ = mapping;
+	mapping_size_ = (size_t) file_stat.st_size;
+#endif
+
+	/* Only the header is read here; the records are paged in as they are used */
+	const SnapshotHeader* header = (const SnapshotHeader*) mapping_;
+	const char* problem = NULL;
+	if ((mapping_size_ < sizeof(SnapshotHeader)) || (memcmp(header->magic, snapshot_magic_g, sizeof(snapshot_magic_g)) != 0)){
+		problem = "not a field snapshot";
+	} else if (header->byte_order != SNAPSHOT_BYTE_ORDER){
+		problem = "written on a machine of different byte order";
+	} else if (header->version != SNAPSHOT_VERSION){
+		problem = "written by a different version";
+	} else if (header->record_size != record_size){
+		problem = "asteroid layout differs from this build";
+	} else if ((header->header_size < sizeof(SnapshotHeader)) ||
+		(mapping_size_ < header->header_size + (size_t) header->num_records*record_size)){
+		problem = "file is truncated";
+	}
+	if (problem != NULL){
+		Ogre::LogManager::getSingleton().logMessage("Field snapshot " + filename + " ignored: " + problem);
+		Unmap();
+		return false;
+	}
+
+	records_ = (char*) mapping_ + header->header_size;
+	num_records_ = (int) header->num_records;
+	seed_ = header->seed;
+	return true;
+}
+
+
+void FieldSnapshot::Unmap(void){
+
+	if (mapping_ == NULL){
+		return;
+	}
+#if defined(_WIN32)
+	UnmapViewOfFile(mapping_);
+	CloseHandle((HANDLE) mapping_handle_);
+	CloseHandle((HANDLE) file_handle_);
+	mapping_handle_ = NULL;
+	file_handle_ = NULL;
+#else
+	munmap(mapping_, mapping_size_);
+#endif
+	mapping_ = NULL;
+	mapping_size_ = 0;
+	records_ = NULL;
+	num_records_ = 0;
+}
+
+
+void FieldSnapshot::Save(const Ogre::String& filename, const void* records, size_t record_size, int count, unsigned int seed){
+
+	/* One save at a time; the buffer belongs to the writer until it is done */
+	WaitForSave();
+
+	SnapshotHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, snapshot_magic_g, sizeof(snapshot_magic_g));
+	header.byte_order = SNAPSHOT_BYTE_ORDER;
+	header.version = SNAPSHOT_VERSION;
+	header.header_size = sizeof(SnapshotHeader);
+	header.record_size = (Ogre::uint32) record_size;
+	header.num_records = (Ogre::uint32) count;
+	header.seed = seed;
+
+	/* The copy is the only work done on the calling thread */
+	save_buffer_.resize(sizeof(SnapshotHeader) + record_size*count);
+	memcpy(&save_buffer_[0], &header, sizeof(SnapshotHeader));
+	if (count > 0){
+		memcpy(&save_buffer_[sizeof(SnapshotHeader)], records, record_size*count);
+	}
+	save_filename_ = filename;
+	writer_ = std::thread(&FieldSnapshot::WriterMain, this);
+}
+
+
+void FieldSnapshot::WaitForSave(void){
+
+	if (writer_.joinable()){
+		writer_.join();
+	}
+}
+
+
+void FieldSnapshot::WriterMain(void){
+
+	AllocationScope scope(AllocField);
+	Ogre::String temporary_filename = save_filename_ + ".tmp";
+	{
+		std::ofstream file(temporary_filename.c_str(), std::ios::out | std::ios::binary);
+		file.write(&save_buffer_[0], save_buffer_.size());
+		if (!file.good()){
+			Ogre::LogManager::getSingleton().logMessage("Field snapshot " + save_filename_ + " could not be written");
+			return;
+		}
+	}
+
+	/* The old snapshot is replaced in one step, so a crash leaves one of the two
+	   whole; rename() does not replace existing files on Windows */
+#if defined(_WIN32)
+	if (!MoveFileExA(temporary_filename.c_str(), save_filename_.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)){
+#else
+	if (rename(temporary_filename.c_str(), save_filename_.c_str()) != 0){
+#endif
+		Ogre::LogManager::getSingleton().logMessage("Field snapshot " + save_filename_ + " could not be replaced");
+		return;
+	}
+	Ogre::LogManager::getSingleton().logMessage("Field snapshot saved to " + save_filename_);
+}
+
+} // namespace ogre_application;
@@ -0,0 +1,80 @@
+#ifndef FIELD_SNAPSHOT_H_
+#define FIELD_SNAPSHOT_H_
+
+#include <vector>
+#include <thread>
+
+#include "OGRE/OgrePlatform.h"
+#include "OGRE/OgreString.h"
+
+namespace ogre_application {
+
+	#define SNAPSHOT_VERSION 1 // Raise when the header or the record layout changes
+	#define SNAPSHOT_BYTE_ORDER 0x01020304 // Reads differently on a machine of the other byte order
+
+	/* Start of a snapshot file; the records follow at header_size bytes */
+	struct SnapshotHeader {
+		char magic[8]; // "ASTFIELD"
+		Ogre::uint32 byte_order;
+		Ogre::uint32 version;
+		Ogre::uint32 header_size;
+		Ogre::uint32 record_size; // Size of an asteroid record, checked against the running build
+		Ogre::uint32 num_records;
+		Ogre::uint32 seed; // Seed the field was generated from
+		Ogre::uint32 reserved[8]; // Pads the header to 64 bytes so the records stay aligned
+	};
+
+	/* Binary snapshot of the asteroid field. The records are stored exactly as they are
+	   laid out in memory, so a snapshot is loaded by mapping the file copy-on-write and
+	   using the mapping as the simulation array: nothing is read until it is touched,
+	   and changes never reach the file. Saving copies the records and writes them from
+	   a background thread */
+	class FieldSnapshot {
+
+		public:
+			FieldSnapshot(void);
+			~FieldSnapshot(void);
+
+			/* Map a snapshot whose records are record_size bytes; returns false if the file
+			   is missing or was written by an incompatible build */
+			bool Map(const Ogre::String& filename, size_t record_size);
+
+			/* Release the mapping; the records must no longer be used */
+			void Unmap(void);
+
+			void* GetRecords(void) const { return records_; }
+			int GetNumRecords(void) const { return num_records_; }
+			unsigned int GetSeed(void) const { return seed_; }
+
+			/* Copy count records and write them to filename in the background. The file is
+			   written under a temporary name and renamed when complete, so a crash never
+			   leaves a partial snapshot behind */
+			void Save(const Ogre::String& filename, const void* records, size_t record_size, int count, unsigned int seed);
+
+			/* Wait until the last save is on disk */
+			void WaitForSave(void);
+
+		private:
+			/* Current mapping */
+			void* mapping_;
+			size_t mapping_size_;
+#if defined(_WIN32)
+			void* file_handle_;
+			void* mapping_handle_;
+#endif
+			void* records_;
+			int num_records_;
+			unsigned int seed_;
+
+			/* Save in progress */
+			std::thread writer_;
+			std::vector<char> save_buffer_; // Header and records, owned by the writer while it runs
+			Ogre::String save_filename_;
+
+			void WriterMain(void);
+
+	}; // class FieldSnapshot
+
+} // namespace ogre_application;
+
+#endif // FIELD_SNAPSHOT_H_
@@ -0,0 +1,87 @@
+#include <new>
+
+#include "frame_arena.h"
+#include "allocation_tracking.h"
+
+namespace ogre_application {
+
+FrameArena::FrameArena(void){
+
+	memory_ = NULL;
+	capacity_ = 0;
+	used_ = 0;
+	overflow_used_ = 0;
+	peak_ = 0;
+}
+
+
+FrameArena::~FrameArena(void){
+
+	Release();
+	delete [] memory_;
+}
+
+
+void FrameArena::Init(size_t capacity){
+
+	AllocationScope scope(AllocFrameArena);
+	Release();
+	delete [] memory_;
+	capacity_ = (capacity + FRAME_ARENA_ALIGNMENT - 1) & ~(size_t) (FRAME_ARENA_ALIGNMENT - 1);
+	memory_ = new char[capacity_];
+	used_ = 0;
+	overflow_.reserve(FRAME_ARENA_MAX_OVERFLOW);
+}
+
+
+void* FrameArena::Allocate(size_t size){
+
+	size = (size + FRAME_ARENA_ALIGNMENT - 1) & ~(size_t) (FRAME_ARENA_ALIGNMENT - 1);
+	if (used_ + size <= capacity_){
+		void* block = memory_ + used_;
+		used_ += size;
+		return block;
+	}
+
+	/* Heap blocks are aligned like the arena */
+	if (overflow_.size() == FRAME_ARENA_MAX_OVERFLOW){
+		throw std::bad_alloc();
+	}
+	AllocationScope scope(AllocFrameArena);
+	char* block = new char[size];
+	overflow_.push_back(block);
+	overflow_used_ += size;
+	return block;
+}
+
+
+void FrameArena::Reset(void){
+
+	size_t total = used_ + overflow_used_;
+	if (total > peak_){
+		peak_ = total;
+	}
+
+	/* The overflow becomes part of the block; its size is the peak, with a margin
+	   so a slowly growing frame does not reallocate every time */
+	if (!overflow_.empty()){
+		Release();
+		AllocationScope scope(AllocFrameArena);
+		delete [] memory_;
+		capacity_ = (peak_ + peak_/4 + FRAME_ARENA_ALIGNMENT - 1) & ~(size_t) (FRAME_ARENA_ALIGNMENT - 1);
+		memory_ = new char[capacity_];
+	}
+	used_ = 0;
+}
+
+
+void FrameArena::Release(void){
+
+	for (size_t i = 0; i < overflow_.size(); i++){
+		delete [] overflow_[i];
+	}
+	overflow_.clear();
+	overflow_used_ = 0;
+}
+
+} // namespace ogre_application;
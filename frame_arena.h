@@ -0,0 +1,50 @@
+#ifndef FRAME_ARENA_H_
+#define FRAME_ARENA_H_
+
+#include <cstddef>
+#include <vector>
+
+namespace ogre_application {
+
+	#define FRAME_ARENA_ALIGNMENT 16 // Alignment of every allocation, enough for SSE
+	#define FRAME_ARENA_MAX_OVERFLOW 64 // Overflow blocks one frame can have
+
+	/* Linear allocator for data that only lives until the end of the frame. An
+	   allocation moves a pointer forward and Reset() frees everything at once.
+	   When a frame needs more than the block holds, the rest comes from separate
+	   heap blocks and the next Reset() grows the block to the peak, so a steady
+	   frame loop stops touching the heap. Only for types without destructors */
+	class FrameArena {
+
+		public:
+			FrameArena(void);
+			~FrameArena(void);
+
+			/* Allocate the block; call once before use */
+			void Init(size_t capacity);
+
+			/* Memory valid until the next Reset() */
+			void* Allocate(size_t size);
+			template <typename T> T* AllocateArray(size_t count) { return static_cast<T*>(Allocate(count*sizeof(T))); }
+
+			/* Free everything allocated since the last call */
+			void Reset(void);
+
+			size_t GetCapacity(void) const { return capacity_; }
+			size_t GetPeak(void) const { return peak_; } // Most bytes one frame has used
+
+		private:
+			char* memory_;
+			size_t capacity_;
+			size_t used_; // Bytes of the block in use
+			size_t overflow_used_; // Bytes in overflow blocks
+			size_t peak_;
+			std::vector<char*> overflow_;
+
+			void Release(void);
+
+	}; // class FrameArena
+
+} // namespace ogre_application;
+
+#endif // FRAME_ARENA_H_
@@ -0,0 +1,408 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <GL/gl.h>
+#else
+#include <GL/gl.h>
+#include <GL/glx.h>
+#endif
+
+#include "OGRE/OgreTextureManager.h"
+#include "OGRE/OgreHardwarePixelBuffer.h"
+#include "OGRE/OgreResourceGroupManager.h"
+#include "OGRE/OgreViewport.h"
+#include "OGRE/OgreLogManager.h"
+
+#include "frame_capture.h"
+#include "allocation_tracking.h"
+
+/* Buffer object entry points are not part of OpenGL 1.1, so they are looked up at run time */
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+#define CAPTURE_GL_PIXEL_PACK_BUFFER 0x88EB
+#define CAPTURE_GL_STREAM_READ 0x88E1
+#define CAPTURE_GL_READ_ONLY 0x88B8
+typedef void (APIENTRY *GenBuffersProc)(GLsizei n, GLuint* buffers);
+typedef void (APIENTRY *DeleteBuffersProc)(GLsizei n, const GLuint* buffers);
+typedef void (APIENTRY *BindBufferProc)(GLenum target, GLuint buffer);
+typedef void (APIENTRY *BufferDataProc)(GLenum target, ptrdiff_t size, const void* data, GLenum usage);
+typedef void* (APIENTRY *MapBufferProc)(GLenum target, GLenum access);
+typedef GLboolean (APIENTRY *UnmapBufferProc)(GLenum target);
+
+namespace ogre_application {
+
+/* Name of the render texture */
+const Ogre::String capture_texture_name_g = "CaptureTexture";
+
+static GenBuffersProc gen_buffers_g = NULL;
+static DeleteBuffersProc delete_buffers_g = NULL;
+static BindBufferProc bind_buffer_g = NULL;
+static BufferDataProc buffer_data_g = NULL;
+static MapBufferProc map_buffer_g = NULL;
+static UnmapBufferProc unmap_buffer_g = NULL;
+
+
+/* Look up an OpenGL function in the current context */
+static void* GetGLFunction(const char* name){
+
+#if defined(_WIN32)
+	return (void*) wglGetProcAddress(name);
+#else
+	return (void*) glXGetProcAddressARB((const GLubyte*) name);
+#endif
+}
+
+
+FrameCapture::FrameCapture(void){
+
+	render_texture_ = NULL;
+	width_ = 0;
+	height_ = 0;
+	format_ = CapturePng;
+	flip_rows_ = false;
+	frame_number_ = 0;
+	async_readback_ = false;
+	texture_id_ = 0;
+	for (int i = 0; i < CAPTURE_READBACK_SLOTS; i++){
+		pixel_buffer_[i] = 0;
+		slot_frame_[i] = -1;
+	}
+	next_slot_ = 0;
+	quit_ = false;
+}
+
+
+FrameCapture::~FrameCapture(void){
+
+	/* Finish() releases GPU objects and must have been called while the render system
+	   was alive; here only the writer thread is stopped */
+	if (writer_.joinable()){
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			quit_ = true;
+		}
+		changed_.notify_all();
+		writer_.join();
+	}
+}
+
+
+void FrameCapture::Init(Ogre::Camera* camera, unsigned int width, unsigned int height, const Ogre::String& directory, CaptureFormat format){
+
+	width_ = width;
+	height_ = height;
+	directory_ = directory;
+	format_ = format;
+
+	/* Render target that sees what the camera sees */
+	texture_ = Ogre::TextureManager::getSingleton().createManual(capture_texture_name_g,
+		Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, Ogre::TEX_TYPE_2D,
+		width, height, 0, Ogre::PF_BYTE_RGBA, Ogre::TU_RENDERTARGET);
+	render_texture_ = texture_->getBuffer()->getRenderTarget();
+	Ogre::Viewport* viewport = render_texture_->addViewport(camera);
+	viewport->setBackgroundColour(Ogre::ColourValue(0.0, 0.0, 0.0));
+	viewport->setOverlaysEnabled(false);
+	render_texture_->setAutoUpdated(false);
+
+	/* Reading the texture directly needs its GL name and buffer objects; other render
+	   systems fall back to a synchronous copy */
+	texture_->getCustomAttribute("GLID", &texture_id_);
+	async_readback_ = (texture_id_ != 0) && LoadGLFunctions();
+	if (async_readback_){
+		/* Texture rows come bottom first unless OGRE renders the texture upside down */
+		flip_rows_ = !render_texture_->requiresTextureFlipping();
+		gen_buffers_g(CAPTURE_READBACK_SLOTS, pixel_buffer_);
+		for (int i = 0; i < CAPTURE_READBACK_SLOTS; i++){
+			bind_buffer_g(CAPTURE_GL_PIXEL_PACK_BUFFER, pixel_buffer_[i]);
+			buffer_data_g(CAPTURE_GL_PIXEL_PACK_BUFFER, width*height*4, NULL, CAPTURE_GL_STREAM_READ);
+		}
+		bind_buffer_g(CAPTURE_GL_PIXEL_PACK_BUFFER, 0);
+	} else {
+		Ogre::LogManager::getSingleton().logMessage("Frame capture: pixel buffer objects not available, reading back synchronously");
+	}
+
+	/* All frame memory is allocated here */
+	for (int i = 0; i < CAPTURE_FRAME_BUFFERS; i++){
+		buffer_[i].resize(width*height*4);
+		free_buffer_.push_back(i);
+	}
+	quit_ = false;
+	writer_ = std::thread(&FrameCapture::WriterMain, this);
+}
+
+
+bool FrameCapture::LoadGLFunctions(void){
+
+	gen_buffers_g = (GenBuffersProc) GetGLFunction("glGenBuffers");
+	delete_buffers_g = (DeleteBuffersProc) GetGLFunction("glDeleteBuffers");
+	bind_buffer_g = (BindBufferProc) GetGLFunction("glBindBuffer");
+	buffer_data_g = (BufferDataProc) GetGLFunction("glBufferData");
+	map_buffer_g = (MapBufferProc) GetGLFunction("glMapBuffer");
+	unmap_buffer_g = (UnmapBufferProc) GetGLFunction("glUnmapBuffer");
+
+	return (gen_buffers_g != NULL) && (delete_buffers_g != NULL) && (bind_buffer_g != NULL) &&
+		(buffer_data_g != NULL) && (map_buffer_g != NULL) && (unmap_buffer_g != NULL);
+}
+
+
+void FrameCapture::Capture(void){
+
+	if (render_texture_ == NULL){
+		return;
+	}
+
+	render_texture_->update();
+
+	if (!async_readback_){
+		int buffer = AcquireBuffer();
+		Ogre::PixelBox box(width_, height_, 1, Ogre::PF_BYTE_RGBA, &buffer_[buffer][0]);
+		render_texture_->copyContentsToMemory(box);
+		QueueFrame(buffer, frame_number_++);
+		return;
+	}
+
+	/* The slot about to be reused holds the oldest frame, which the GPU has finished by now */
+	int slot = next_slot_;
+	if (slot_frame_[slot] >= 0){
+		CompleteReadback(slot);
+	}
+	IssueReadback(slot);
+	slot_frame_[slot] = frame_number_++;
+	next_slot_ = (slot + 1) % CAPTURE_READBACK_SLOTS;
+}
+
+
+void FrameCapture::IssueReadback(int slot){
+
+	/* With a pack buffer bound the copy is queued on the GPU and the call returns at once.
+	   OGRE caches texture bindings, so the previous binding is restored */
+	GLint previous_texture = 0;
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &previous_texture);
+	bind_buffer_g(CAPTURE_GL_PIXEL_PACK_BUFFER, pixel_buffer_[slot]);
+	glBindTexture(GL_TEXTURE_2D, texture_id_);
+	glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glBindTexture(GL_TEXTURE_2D, previous_texture);
+	bind_buffer_g(CAPTURE_GL_PIXEL_PACK_BUFFER, 0);
+}
+
+
+void FrameCapture::CompleteReadback(int slot){
+
+	int buffer = AcquireBuffer();
+	bind_buffer_g(CAPTURE_GL_PIXEL_PACK_BUFFER, pixel_buffer_[slot]);
+	void* data = map_buffer_g(CAPTURE_GL_PIXEL_PACK_BUFFER, CAPTURE_GL_READ_ONLY);
+	if (data != NULL){
+		memcpy(&buffer_[buffer][0], data, buffer_[buffer].size());
+		unmap_buffer_g(CAPTURE_GL_PIXEL_PACK_BUFFER);
+	}
+	bind_buffer_g(CAPTURE_GL_PIXEL_PACK_BUFFER, 0);
+
+	QueueFrame(buffer, slot_frame_[slot]);
+	slot_frame_[slot] = -1;
+}
+
+
+void FrameCapture::Finish(void){
+
+	if (render_texture_ == NULL){
+		return;
+	}
+
+	/* Collect the frames still in flight, oldest first */
+	if (async_readback_){
+		for (int i = 0; i < CAPTURE_READBACK_SLOTS; i++){
+			int slot = (next_slot_ + i) % CAPTURE_READBACK_SLOTS;
+			if (slot_frame_[slot] >= 0){
+				CompleteReadback(slot);
+			}
+		}
+		delete_buffers_g(CAPTURE_READBACK_SLOTS, pixel_buffer_);
+	}
+
+	/* The writer drains its queue before it stops */
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		quit_ = true;
+	}
+	changed_.notify_all();
+	writer_.join();
+
+	render_texture_ = NULL;
+	texture_.setNull();
+	Ogre::TextureManager::getSingleton().remove(capture_texture_name_g);
+}
+
+
+int FrameCapture::AcquireBuffer(void){
+
+	/* When the writer falls behind, rendering waits rather than dropping frames */
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (free_buffer_.empty()){
+		changed_.wait(lock);
+	}
+	int buffer = free_buffer_.back();
+	free_buffer_.pop_back();
+	return buffer;
+}
+
+
+void FrameCapture::QueueFrame(int buffer, int frame_number){
+
+	PendingFrame frame;
+	frame.buffer = buffer;
+	frame.frame_number = frame_number;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		pending_.push_back(frame);
+	}
+	changed_.notify_all();
+}
+
+
+void FrameCapture::WriterMain(void){
+
+	/* Encoding buffers are charged to the capture */
+	AllocationScope scope(AllocCapture);
+	while (true){
+		PendingFrame frame;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			while (pending_.empty() && !quit_){
+				changed_.wait(lock);
+			}
+			if (pending_.empty()){
+				return;
+			}
+			frame = pending_.front();
+			pending_.pop_front();
+		}
+
+		WriteFrame(&buffer_[frame.buffer][0], frame.frame_number);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			free_buffer_.push_back(frame.buffer);
+		}
+		changed_.notify_all();
+	}
+}
+
+
+/* CRC-32 as used by PNG chunks */
+static unsigned int Crc32(unsigned int crc, const unsigned char* data, size_t size){
+
+	static unsigned int table[256];
+	static bool table_ready = false;
+	if (!table_ready){
+		for (unsigned int n = 0; n < 256; n++){
+			unsigned int c = n;
+			for (int k = 0; k < 8; k++){
+				c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+			}
+			table[n] = c;
+		}
+		table_ready = true;
+	}
+
+	crc = ~crc;
+	for (size_t i = 0; i < size; i++){
+		crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+
+/* Append a 32-bit big-endian value */
+static void PutBigEndian(std::vector<unsigned char>& out, unsigned int value){
+
+	out.push_back((unsigned char) (value >> 24));
+	out.push_back((unsigned char) (value >> 16));
+	out.push_back((unsigned char) (value >> 8));
+	out.push_back((unsigned char) value);
+}
+
+
+/* Append a PNG chunk */
+static void PutChunk(std::vector<unsigned char>& out, const char* type, const unsigned char* data, size_t size){
+
+	PutBigEndian(out, (unsigned int) size);
+	size_t start = out.size();
+	out.insert(out.end(), type, type + 4);
+	out.insert(out.end(), data, data + size);
+	PutBigEndian(out, Crc32(0, &out[start], out.size() - start));
+}
+
+
+void FrameCapture::WriteFrame(const unsigned char* pixels, int frame_number){
+
+	char name[32];
+	sprintf(name, (format_ == CapturePng) ? "/frame_%06d.png" : "/frame_%06d.rgba", frame_number);
+	std::ofstream file((directory_ + name).c_str(), std::ios::out | std::ios::binary);
+	if (!file.is_open()){
+		Ogre::LogManager::getSingleton().logMessage("Frame capture: cannot write " + directory_ + name);
+		return;
+	}
+
+	size_t row_size = width_*4;
+	if (format_ == CaptureRaw){
+		for (unsigned int row = 0; row < height_; row++){
+			unsigned int source_row = flip_rows_ ? (height_ - 1 - row) : row;
+			file.write((const char*) pixels + source_row*row_size, row_size);
+		}
+		return;
+	}
+
+	/* Scanlines with filter type 0, stored in uncompressed deflate blocks: speed over size */
+	std::vector<unsigned char> scanlines;
+	scanlines.reserve((row_size + 1)*height_);
+	for (unsigned int row = 0; row < height_; row++){
+		unsigned int source_row = flip_rows_ ? (height_ - 1 - row) : row;
+		scanlines.push_back(0);
+		scanlines.insert(scanlines.end(), pixels + source_row*row_size, pixels + (source_row + 1)*row_size);
+	}
+
+	std::vector<unsigned char> zlib;
+	zlib.reserve(scanlines.size() + scanlines.size()/65535*5 + 16);
+	zlib.push_back(0x78);
+	zlib.push_back(0x01);
+	size_t pos = 0;
+	do {
+		size_t block = std::min(scanlines.size() - pos, (size_t) 65535);
+		bool last = (pos + block == scanlines.size());
+		zlib.push_back(last ? 1 : 0);
+		zlib.push_back((unsigned char) (block & 0xFF));
+		zlib.push_back((unsigned char) (block >> 8));
+		zlib.push_back((unsigned char) (~block & 0xFF));
+		zlib.push_back((unsigned char) ((~block >> 8) & 0xFF));
+		zlib.insert(zlib.end(), scanlines.begin() + pos, scanlines.begin() + pos + block);
+		pos += block;
+	} while (pos < scanlines.size());
+	unsigned int a = 1, b = 0;
+	for (size_t i = 0; i < scanlines.size(); i++){
+		a = (a + scanlines[i]) % 65521;
+		b = (b + a) % 65521;
+	}
+	PutBigEndian(zlib, (b << 16) | a);
+
+	std::vector<unsigned char> header;
+	PutBigEndian(header, width_);
+	PutBigEndian(header, height_);
+	const unsigned char header_rest[5] = {8, 6, 0, 0, 0}; // 8 bits per channel, RGBA
+	header.insert(header.end(), header_rest, header_rest + 5);
+
+	const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+	std::vector<unsigned char> png(signature, signature + 8);
+	PutChunk(png, "IHDR", &header[0], header.size());
+	PutChunk(png, "IDAT", &zlib[0], zlib.size());
+	PutChunk(png, "IEND", NULL, 0);
+	file.write((const char*) &png[0], png.size());
+}
+
+} // namespace ogre_application;
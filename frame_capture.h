@@ -0,0 +1,89 @@
+#ifndef FRAME_CAPTURE_H_
+#define FRAME_CAPTURE_H_
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "OGRE/OgreCamera.h"
+#include "OGRE/OgreTexture.h"
+#include "OGRE/OgreRenderTexture.h"
+
+namespace ogre_application {
+
+	#define CAPTURE_READBACK_SLOTS 3 // Frames in flight between rendering and reading back
+	#define CAPTURE_FRAME_BUFFERS 8 // Frames that can wait for the writer thread
+
+	/* File format of captured frames */
+	enum CaptureFormat {
+		CaptureRaw, // Bare RGBA bytes, top row first, one file per frame
+		CapturePng // Uncompressed PNG, one file per frame
+	};
+
+	/* Renders the camera view to a texture and saves every frame. Pixels are copied
+	   into a ring of pixel buffer objects and only read a few frames later, when the
+	   GPU is done with them, so capturing does not stall the pipeline. Files are
+	   written by a background thread */
+	class FrameCapture {
+
+		public:
+			FrameCapture(void);
+			~FrameCapture(void);
+
+			/* Create the render texture and start the writer thread */
+			void Init(Ogre::Camera* camera, unsigned int width, unsigned int height, const Ogre::String& directory, CaptureFormat format);
+
+			bool IsActive(void) const { return render_texture_ != NULL; }
+
+			/* Render the camera to the texture and queue the frame for saving */
+			void Capture(void);
+
+			/* Read back the frames still in flight, wait for the writer and release the
+			   GPU objects; call before the render system shuts down */
+			void Finish(void);
+
+		private:
+			Ogre::TexturePtr texture_;
+			Ogre::RenderTexture* render_texture_;
+			unsigned int width_;
+			unsigned int height_;
+			Ogre::String directory_;
+			CaptureFormat format_;
+			bool flip_rows_; // Whether the texture holds the bottom row first
+			int frame_number_; // Number of the next frame to be rendered
+
+			/* Readback ring; slot_frame_ is the number of the frame in each slot, or -1 */
+			bool async_readback_; // False when pixel buffer objects are not available
+			unsigned int texture_id_;
+			unsigned int pixel_buffer_[CAPTURE_READBACK_SLOTS];
+			int slot_frame_[CAPTURE_READBACK_SLOTS];
+			int next_slot_;
+
+			/* Frames handed to the writer thread; buffers are allocated once */
+			struct PendingFrame {
+				int buffer;
+				int frame_number;
+			};
+			std::vector<unsigned char> buffer_[CAPTURE_FRAME_BUFFERS];
+			std::vector<int> free_buffer_;
+			std::deque<PendingFrame> pending_;
+			std::mutex mutex_;
+			std::condition_variable changed_;
+			std::thread writer_;
+			bool quit_;
+
+			bool LoadGLFunctions(void);
+			void IssueReadback(int slot);
+			void CompleteReadback(int slot);
+			int AcquireBuffer(void);
+			void QueueFrame(int buffer, int frame_number);
+			void WriterMain(void);
+			void WriteFrame(const unsigned char* pixels, int frame_number);
+
+	}; // class FrameCapture
+
+} // namespace ogre_application;
+
+#endif // FRAME_CAPTURE_H_
@@ -0,0 +1,118 @@
+#include <chrono>
+
+#include "input_thread.h"
+
+namespace ogre_application {
+
+InputThread::InputThread(void){
+
+	keyboard_ = NULL;
+	mouse_ = NULL;
+	quit_ = false;
+	dropped_events_ = 0;
+	mouse_area_ = 0;
+	period_ = 1000;
+	capture_time_ = 0;
+}
+
+
+InputThread::~InputThread(void){
+
+	Stop();
+}
+
+
+unsigned long long InputThread::Now(void){
+
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+void InputThread::Start(OIS::Keyboard* keyboard, OIS::Mouse* mouse, int rate){
+
+	Stop();
+	keyboard_ = keyboard;
+	mouse_ = mouse;
+	period_ = 1000000 / rate;
+	quit_ = false;
+	keyboard_->setEventCallback(this);
+	thread_ = std::thread(&InputThread::ThreadMain, this);
+}
+
+
+void InputThread::Stop(void){
+
+	if (thread_.joinable()){
+		quit_ = true;
+		thread_.join();
+	}
+}
+
+
+void InputThread::SetMouseArea(int width, int height){
+
+	mouse_area_ = ((unsigned long long) width << 32) | (unsigned int) height;
+	if (!thread_.joinable()){
+		ApplyMouseArea();
+	}
+}
+
+
+void InputThread::ApplyMouseArea(void){
+
+	unsigned long long area = mouse_area_.exchange(0);
+	if ((area != 0) && (mouse_ != NULL)){
+		const OIS::MouseState &ms = mouse_->getMouseState();
+		ms.width = (int) (area >> 32);
+		ms.height = (int) (area & 0xffffffff);
+	}
+}
+
+
+void InputThread::ThreadMain(void){
+
+	/* Captures are scheduled from the start so the rate does not drift */
+	unsigned long long next_capture = Now();
+	while (!quit_){
+		ApplyMouseArea();
+		capture_time_ = Now();
+		keyboard_->capture();
+		mouse_->capture();
+
+		next_capture += period_;
+		unsigned long long now = Now();
+		if (next_capture < now){
+			next_capture = now;
+		} else {
+			std::this_thread::sleep_for(std::chrono::microseconds(next_capture - now));
+		}
+	}
+}
+
+
+void InputThread::Queue(int key, bool pressed){
+
+	InputEvent event;
+	event.time = capture_time_;
+	event.key = key;
+	event.pressed = pressed;
+	if (!queue_.Push(event)){
+		dropped_events_++;
+	}
+}
+
+
+bool InputThread::keyPressed(const OIS::KeyEvent& arg){
+
+	Queue(arg.key, true);
+	return true;
+}
+
+
+bool InputThread::keyReleased(const OIS::KeyEvent& arg){
+
+	Queue(arg.key, false);
+	return true;
+}
+
+} // namespace ogre_application;
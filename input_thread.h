@@ -0,0 +1,109 @@
+#ifndef INPUT_THREAD_H_
+#define INPUT_THREAD_H_
+
+#include <thread>
+#include <atomic>
+
+#include "OIS/OIS.h"
+
+namespace ogre_application {
+
+	#define INPUT_QUEUE_SIZE 1024 // Events the queue holds; a power of two
+
+	/* A key going down or up */
+	struct InputEvent {
+		unsigned long long time; // Microseconds on the clock of InputThread::Now()
+		int key; // OIS key code
+		bool pressed;
+	};
+
+	/* Fixed-size ring of events from one producer thread to one consumer thread,
+	   without locks: each side only writes its own index */
+	class InputQueue {
+
+		public:
+			InputQueue(void) : head_(0), tail_(0) {}
+
+			/* Producer; false when the queue is full */
+			bool Push(const InputEvent& event){
+				unsigned int tail = tail_.load(std::memory_order_relaxed);
+				unsigned int next = (tail + 1) & (INPUT_QUEUE_SIZE - 1);
+				if (next == head_.load(std::memory_order_acquire)){
+					return false;
+				}
+				event_[tail] = event;
+				tail_.store(next, std::memory_order_release);
+				return true;
+			}
+
+			/* Consumer; the oldest event, or NULL when there is none */
+			const InputEvent* Front(void) const {
+				unsigned int head = head_.load(std::memory_order_relaxed);
+				if (head == tail_.load(std::memory_order_acquire)){
+					return NULL;
+				}
+				return &event_[head];
+			}
+
+			/* Consumer; drop the event returned by Front() */
+			void Pop(void){
+				unsigned int head = head_.load(std::memory_order_relaxed);
+				head_.store((head + 1) & (INPUT_QUEUE_SIZE - 1), std::memory_order_release);
+			}
+
+		private:
+			InputEvent event_[INPUT_QUEUE_SIZE];
+			std::atomic<unsigned int> head_; // Next event to read, written by the consumer
+			std::atomic<unsigned int> tail_; // Next slot to write, written by the producer
+
+	}; // class InputQueue
+
+	/* Samples the keyboard and mouse on a thread of its own at a fixed rate. The
+	   keyboard is buffered, so every press and release reaches the queue, stamped
+	   with the time of the capture that saw it, however short the tap. OIS devices
+	   read their own event streams, so capturing them away from the window thread
+	   is safe; nothing else may use them while the thread runs */
+	class InputThread : public OIS::KeyListener {
+
+		public:
+			InputThread(void);
+			~InputThread(void);
+
+			/* Start sampling rate times per second; the keyboard must be buffered */
+			void Start(OIS::Keyboard* keyboard, OIS::Mouse* mouse, int rate);
+			void Stop(void);
+
+			/* The area the mouse is clipped to, normally the window size; while the thread
+			   runs it is handed over and applied before the next capture */
+			void SetMouseArea(int width, int height);
+
+			InputQueue& GetQueue(void) { return queue_; }
+			int GetDroppedEvents(void) const { return dropped_events_; } // Events lost to a full queue
+
+			/* Current time in microseconds, on the clock of the event times */
+			static unsigned long long Now(void);
+
+		private:
+			OIS::Keyboard* keyboard_;
+			OIS::Mouse* mouse_;
+			InputQueue queue_;
+			std::thread thread_;
+			std::atomic<bool> quit_;
+			std::atomic<int> dropped_events_;
+			std::atomic<unsigned long long> mouse_area_; // Width in the high half and height in the low half; zero once applied
+			unsigned long long period_; // Microseconds between captures
+			unsigned long long capture_time_; // Time of the capture in progress
+
+			void ThreadMain(void);
+			void ApplyMouseArea(void);
+			void Queue(int key, bool pressed);
+
+			/* Called by the keyboard during capture */
+			bool keyPressed(const OIS::KeyEvent& arg);
+			bool keyReleased(const OIS::KeyEvent& arg);
+
+	}; // class InputThread
+
+} // namespace ogre_application;
+
+#endif // INPUT_THREAD_H_
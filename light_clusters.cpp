@@ -0,0 +1,266 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "OGRE/OgreTextureManager.h"
+#include "OGRE/OgreMaterialManager.h"
+#include "OGRE/OgreTechnique.h"
+#include "OGRE/OgrePass.h"
+#include "OGRE/OgreHardwarePixelBuffer.h"
+#include "OGRE/OgreResourceGroupManager.h"
+
+#include "light_clusters.h"
+
+namespace ogre_application {
+
+/* Names of the data textures */
+const Ogre::String light_texture_name_g = "ClusterLightData";
+const Ogre::String cluster_texture_name_g = "ClusterGrid";
+const Ogre::String index_texture_name_g = "ClusterLightIndices";
+
+
+LightClusters::LightClusters(void){
+
+	num_lights_ = 0;
+	near_ = 1.0f;
+	far_ = 2.0f;
+	slice_scale_ = 0.0f;
+	slice_bias_ = 0.0f;
+}
+
+
+void LightClusters::Init(const Ogre::String& material_name, const Ogre::Camera* camera){
+
+	/* Exponential depth slices: slice = log(depth)*scale + bias, so that slice 0
+	   starts at the near plane and the last slice ends at the far plane */
+	near_ = camera->getNearClipDistance();
+	far_ = camera->getFarClipDistance();
+	float log_ratio = log(far_ / near_);
+	slice_scale_ = CLUSTER_DIM_Z / log_ratio;
+	slice_bias_ = -CLUSTER_DIM_Z * log(near_) / log_ratio;
+
+	/* Allocate everything up front, so that no allocation happens per frame */
+	light_data_.assign(MAX_NUM_LIGHTS*2*4, 0.0f);
+	cluster_data_.assign(NUM_CLUSTERS*4, 0.0f);
+	index_data_.assign(MAX_LIGHT_INDICES, 0.0f);
+	cluster_count_.assign(NUM_CLUSTERS, 0);
+	cluster_offset_.assign(NUM_CLUSTERS, 0);
+
+	/* Create the textures that carry the light lists to the fragment shader */
+	Ogre::TextureManager& texture_manager = Ogre::TextureManager::getSingleton();
+	const Ogre::String& group = Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME;
+	light_texture_ = texture_manager.createManual(light_texture_name_g, group, Ogre::TEX_TYPE_2D,
+		2, MAX_NUM_LIGHTS, 0, Ogre::PF_FLOAT32_RGBA, Ogre::TU_DYNAMIC_WRITE_ONLY_DISCARDABLE);
+	cluster_texture_ = texture_manager.createManual(cluster_texture_name_g, group, Ogre::TEX_TYPE_2D,
+		CLUSTER_DIM_X*CLUSTER_DIM_Y, CLUSTER_DIM_Z, 0, Ogre::PF_FLOAT32_RGBA, Ogre::TU_DYNAMIC_WRITE_ONLY_DISCARDABLE);
+	index_texture_ = texture_manager.createManual(index_texture_name_g, group, Ogre::TEX_TYPE_2D,
+		LIGHT_INDEX_TEXTURE_WIDTH, LIGHT_INDEX_TEXTURE_HEIGHT, 0, Ogre::PF_FLOAT32_RGBA, Ogre::TU_DYNAMIC_WRITE_ONLY_DISCARDABLE);
+
+	/* Bind the textures to the material; they are read with texelFetch, so no filtering */
+	Ogre::MaterialPtr material = Ogre::MaterialManager::getSingleton().getByName(material_name);
+	Ogre::Pass* pass = material->getTechnique(0)->getPass(0);
+	const Ogre::String* texture_name[3] = {&light_texture_name_g, &cluster_texture_name_g, &index_texture_name_g};
+	for (int i = 0; i < 3; i++){
+		Ogre::TextureUnitState* unit = pass->createTextureUnitState(*texture_name[i]);
+		unit->setTextureFiltering(Ogre::TFO_NONE);
+		unit->setTextureAddressingMode(Ogre::TextureUnitState::TAM_CLAMP);
+	}
+
+	/* Cluster layout used by the fragment shader to find its cluster */
+	Ogre::GpuProgramParametersSharedPtr params = pass->getFragmentProgramParameters();
+	params->setNamedConstant("cluster_dims", Ogre::Vector3(CLUSTER_DIM_X, CLUSTER_DIM_Y, CLUSTER_DIM_Z));
+	params->setNamedConstant("slice_params", Ogre::Vector3(slice_scale_, slice_bias_, 0.0f));
+
+	/* Start with empty lists */
+	Upload(light_texture_, &light_data_[0], 2, MAX_NUM_LIGHTS);
+	Upload(cluster_texture_, &cluster_data_[0], CLUSTER_DIM_X*CLUSTER_DIM_Y, CLUSTER_DIM_Z);
+	Upload(index_texture_, &index_data_[0], LIGHT_INDEX_TEXTURE_WIDTH, LIGHT_INDEX_TEXTURE_HEIGHT);
+}
+
+
+void LightClusters::Destroy(void){
+
+	light_texture_.setNull();
+	cluster_texture_.setNull();
+	index_texture_.setNull();
+	num_lights_ = 0;
+}
+
+
+void LightClusters::AddLight(const Ogre::Vector3& pos, const Ogre::ColourValue& colour, float radius, float intensity, float life){
+
+	/* Once the budget is used up, new lights are dropped */
+	if (num_lights_ >= MAX_NUM_LIGHTS){
+		return;
+	}
+
+	PointLight& light = light_[num_lights_++];
+	light.pos = pos;
+	light.colour = colour;
+	light.radius = radius;
+	light.intensity = intensity;
+	light.life = life;
+	light.max_life = life;
+}
+
+
+void LightClusters::Update(const Ogre::Camera* camera, float elapsed_time){
+
+	if (light_texture_.isNull()){
+		return;
+	}
+
+	/* Build and upload the lists for the lights of this frame */
+	BinLights(camera);
+	Upload(light_texture_, &light_data_[0], 2, MAX_NUM_LIGHTS);
+	Upload(cluster_texture_, &cluster_data_[0], CLUSTER_DIM_X*CLUSTER_DIM_Y, CLUSTER_DIM_Z);
+	Upload(index_texture_, &index_data_[0], LIGHT_INDEX_TEXTURE_WIDTH, LIGHT_INDEX_TEXTURE_HEIGHT);
+
+	/* Age the lights and remove the expired ones by moving the last light into their slot */
+	int i = 0;
+	while (i < num_lights_){
+		light_[i].life -= elapsed_time;
+		if (light_[i].life < 0.0f){
+			light_[i] = light_[--num_lights_];
+		} else {
+			i++;
+		}
+	}
+}
+
+
+int LightClusters::DepthSlice(float depth) const {
+
+	int slice = (int) floor(log(depth)*slice_scale_ + slice_bias_);
+	return std::min(std::max(slice, 0), CLUSTER_DIM_Z - 1);
+}
+
+
+/* Convert a coordinate in normalized device space to a tile index */
+static int Tile(float ndc, int num_tiles){
+
+	int tile = (int) floor((ndc*0.5f + 0.5f)*num_tiles);
+	return std::min(std::max(tile, 0), num_tiles - 1);
+}
+
+
+void LightClusters::BinLights(const Ogre::Camera* camera){
+
+	const Ogre::Matrix4& view = camera->getViewMatrix();
+	const Ogre::Matrix4& proj = camera->getProjectionMatrix();
+	float x_scale = proj[0][0];
+	float y_scale = proj[1][1];
+
+	std::fill(cluster_count_.begin(), cluster_count_.end(), 0);
+
+	/* First pass: transform the lights to view space and count the lights of each cluster */
+	for (int i = 0; i < num_lights_; i++){
+		const PointLight& light = light_[i];
+		Ogre::Vector3 p = view.transformAffine(light.pos);
+		float r = light.radius;
+		float depth = -p.z;
+
+		/* Lights fade out linearly over their lifetime */
+		float fade = (light.max_life > 0.0f) ? (light.life / light.max_life) : 1.0f;
+		float* data = &light_data_[i*8];
+		data[0] = p.x;
+		data[1] = p.y;
+		data[2] = p.z;
+		data[3] = r;
+		data[4] = light.colour.r*light.intensity*fade;
+		data[5] = light.colour.g*light.intensity*fade;
+		data[6] = light.colour.b*light.intensity*fade;
+		data[7] = 1.0f;
+
+		ClusterRange& range = range_[i];
+		range.x0 = range.y0 = range.z0 = 1;
+		range.x1 = range.y1 = range.z1 = 0;
+		if ((depth + r < near_) || (depth - r > far_)){
+			continue;
+		}
+		range.z0 = DepthSlice(std::max(depth - r, near_));
+		range.z1 = DepthSlice(std::min(depth + r, far_));
+
+		if (depth - r <= near_){
+			/* The sphere crosses the near plane, so it can cover the whole screen */
+			range.x0 = 0;
+			range.x1 = CLUSTER_DIM_X - 1;
+			range.y0 = 0;
+			range.y1 = CLUSTER_DIM_Y - 1;
+		} else {
+			/* Conservative screen bounds of the sphere: divide each extreme of its box
+			   by the depth that makes the projection largest */
+			float z_near = depth - r, z_far = depth + r;
+			float x_max = (p.x + r) / ((p.x + r > 0.0f) ? z_near : z_far) * x_scale;
+			float x_min = (p.x - r) / ((p.x - r < 0.0f) ? z_near : z_far) * x_scale;
+			float y_max = (p.y + r) / ((p.y + r > 0.0f) ? z_near : z_far) * y_scale;
+			float y_min = (p.y - r) / ((p.y - r < 0.0f) ? z_near : z_far) * y_scale;
+			if ((x_min > 1.0f) || (x_max < -1.0f) || (y_min > 1.0f) || (y_max < -1.0f)){
+				range.z0 = 1;
+				range.z1 = 0;
+				continue;
+			}
+			range.x0 = Tile(x_min, CLUSTER_DIM_X);
+			range.x1 = Tile(x_max, CLUSTER_DIM_X);
+			range.y0 = Tile(y_min, CLUSTER_DIM_Y);
+			range.y1 = Tile(y_max, CLUSTER_DIM_Y);
+		}
+
+		for (int z = range.z0; z <= range.z1; z++){
+			for (int y = range.y0; y <= range.y1; y++){
+				int cluster = z*CLUSTER_DIM_X*CLUSTER_DIM_Y + y*CLUSTER_DIM_X + range.x0;
+				for (int x = range.x0; x <= range.x1; x++, cluster++){
+					if (cluster_count_[cluster] < MAX_LIGHTS_PER_CLUSTER){
+						cluster_count_[cluster]++;
+					}
+				}
+			}
+		}
+	}
+
+	/* Prefix sum gives the start of each cluster's list; lists that would overflow
+	   the index texture are cut short */
+	int offset = 0;
+	for (int c = 0; c < NUM_CLUSTERS; c++){
+		int count = std::min(cluster_count_[c], MAX_LIGHT_INDICES - offset);
+		cluster_count_[c] = count;
+		cluster_offset_[c] = offset;
+		cluster_data_[c*4 + 0] = (float) offset;
+		cluster_data_[c*4 + 1] = (float) count;
+		offset += count;
+	}
+
+	/* Second pass: write the light indices, using the offsets as write cursors */
+	for (int i = 0; i < num_lights_; i++){
+		const ClusterRange& range = range_[i];
+		for (int z = range.z0; z <= range.z1; z++){
+			for (int y = range.y0; y <= range.y1; y++){
+				int cluster = z*CLUSTER_DIM_X*CLUSTER_DIM_Y + y*CLUSTER_DIM_X + range.x0;
+				for (int x = range.x0; x <= range.x1; x++, cluster++){
+					int end = (int) cluster_data_[cluster*4] + cluster_count_[cluster];
+					if (cluster_offset_[cluster] < end){
+						index_data_[cluster_offset_[cluster]++] = (float) i;
+					}
+				}
+			}
+		}
+	}
+}
+
+
+void LightClusters::Upload(Ogre::TexturePtr& texture, const float* data, size_t width, size_t height){
+
+	Ogre::HardwarePixelBufferSharedPtr buffer = texture->getBuffer();
+	buffer->lock(Ogre::HardwareBuffer::HBL_DISCARD);
+	const Ogre::PixelBox& box = buffer->getCurrentLock();
+
+	/* Rows of the locked buffer may be padded */
+	float* dest = static_cast<float*>(box.data);
+	for (size_t row = 0; row < height; row++){
+		memcpy(dest + row*box.rowPitch*4, data + row*width*4, width*4*sizeof(float));
+	}
+
+	buffer->unlock();
+}
+
+} // namespace ogre_application;
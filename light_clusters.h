@@ -0,0 +1,96 @@
+#ifndef LIGHT_CLUSTERS_H_
+#define LIGHT_CLUSTERS_H_
+
+#include <vector>
+
+#include "OGRE/OgreCamera.h"
+#include "OGRE/OgreTexture.h"
+#include "OGRE/OgreMaterial.h"
+
+namespace ogre_application {
+
+	/* Resolution of the cluster grid: the view frustum is split into
+	   CLUSTER_DIM_X * CLUSTER_DIM_Y screen tiles and CLUSTER_DIM_Z exponential depth slices */
+	#define CLUSTER_DIM_X 16
+	#define CLUSTER_DIM_Y 9
+	#define CLUSTER_DIM_Z 24
+	#define NUM_CLUSTERS (CLUSTER_DIM_X*CLUSTER_DIM_Y*CLUSTER_DIM_Z)
+
+	/* Limits that bound memory and per-fragment cost */
+	#define MAX_NUM_LIGHTS 1024 // Lights alive at the same time
+	#define MAX_LIGHTS_PER_CLUSTER 32 // Lights a single fragment can loop over
+	#define LIGHT_INDEX_TEXTURE_WIDTH 256 // Texels per row of the light index texture
+	#define LIGHT_INDEX_TEXTURE_HEIGHT 32 // Four indices are packed per texel
+	#define MAX_LIGHT_INDICES (LIGHT_INDEX_TEXTURE_WIDTH*LIGHT_INDEX_TEXTURE_HEIGHT*4)
+
+	/* A dynamic point light */
+	struct PointLight {
+		Ogre::Vector3 pos; // Position in world coordinates
+		Ogre::ColourValue colour; // Colour of the light
+		float radius; // Distance at which the light falls off to zero
+		float intensity; // Current brightness
+		float life; // Remaining lifetime in seconds
+		float max_life; // Lifetime at creation, used to fade the light out
+	};
+
+	/* Clustered forward lighting: lights are binned into the clusters of the view
+	   frustum on the CPU and the resulting lists are uploaded to textures that the
+	   fragment shader reads */
+	class LightClusters {
+
+		public:
+			LightClusters(void);
+
+			/* Create the data textures and bind them to the given material */
+			void Init(const Ogre::String& material_name, const Ogre::Camera* camera);
+
+			/* Release the textures; call before the render system shuts down */
+			void Destroy(void);
+
+			/* Add a light that lives for the given time; a lifetime of zero keeps it for
+			   a single frame, which suits lights that are re-emitted every frame */
+			void AddLight(const Ogre::Vector3& pos, const Ogre::ColourValue& colour, float radius, float intensity, float life);
+
+			/* Age the lights, rebuild the cluster lists for the camera and upload them */
+			void Update(const Ogre::Camera* camera, float elapsed_time);
+
+			int GetNumLights(void) const { return num_lights_; }
+
+		private:
+			/* Lights currently alive */
+			PointLight light_[MAX_NUM_LIGHTS];
+			int num_lights_;
+
+			/* Cluster range covered by each light, filled during binning */
+			struct ClusterRange {
+				short x0, x1, y0, y1, z0, z1;
+			};
+			ClusterRange range_[MAX_NUM_LIGHTS];
+
+			/* CPU copies of the texture contents */
+			std::vector<float> light_data_; // Two texels per light: view position and radius, colour
+			std::vector<float> cluster_data_; // One texel per cluster: offset into the index list, count
+			std::vector<float> index_data_; // Light indices, four per texel
+			std::vector<int> cluster_count_;
+			std::vector<int> cluster_offset_;
+
+			/* Textures read by the fragment shader */
+			Ogre::TexturePtr light_texture_;
+			Ogre::TexturePtr cluster_texture_;
+			Ogre::TexturePtr index_texture_;
+
+			/* Depth slicing parameters */
+			float near_;
+			float far_;
+			float slice_scale_;
+			float slice_bias_;
+
+			int DepthSlice(float depth) const;
+			void BinLights(const Ogre::Camera* camera);
+			void Upload(Ogre::TexturePtr& texture, const float* data, size_t width, size_t height);
+
+	}; // class LightClusters
+
+} // namespace ogre_application;
+
+#endif // LIGHT_CLUSTERS_H_
@@ -1,5 +1,7 @@
 #include <iostream>
 #include <exception>
+#include <cstring>
+#include <cstdlib>
 #include "ogre_application.h"
 
 /* Macro for printing exceptions */
@@ -7,15 +9,88 @@
 	std::cerr << exception_object.what() << std::endl
 
 /* Main function that builds and runs the application */
-int main(void){
+/* Options: --vsync (default), --uncapped, --fps=N to limit the frame rate,
+   --late-input to apply input right before rendering, --bindings=FILE to read the controls from a file,
+   --capture=DIR or --capture-raw=DIR to save every frame as PNG or raw RGBA,
+   --offscreen to render only to the capture texture, --frames=N to stop after N frames,
+   --morton-sort=SECONDS to keep the asteroids in spatial order, sorting again at that period,
+   --field=FILE to load the asteroid field from a snapshot, or to save it there (F5 saves again),
+   --asteroids=N to generate a field of N asteroids (1500 by default, ignored when a snapshot is loaded),
+   --seed=N to generate a different field, --compact to animate and cull the field from quantised state,
+   --occlusion to skip asteroids hidden behind nearer ones,
+   --views=rear,tactical to draw a rear view and a tactical overview of the field over the pilot view,
+   --ship-collision=stop|bounce|destroy|off to choose what the ship does when it hits an asteroid,
+   --alloc-check=report|fatal to catch heap allocations in the frame loop once it is warmed up */
+int main(int argc, char* argv[]){
     ogre_application::OgreApplication application;
+	int num_asteroids = 1500;
+
+	for (int i = 1; i < argc; i++){
+		if (strcmp(argv[i], "--vsync") == 0){
+			application.SetFramePacing(ogre_application::VSync, 0.0f);
+		} else if (strcmp(argv[i], "--uncapped") == 0){
+			application.SetFramePacing(ogre_application::Uncapped, 0.0f);
+		} else if ((strncmp(argv[i], "--fps=", 6) == 0) && (atof(argv[i] + 6) > 0.0)){
+			application.SetFramePacing(ogre_application::FrameLimited, (float) atof(argv[i] + 6));
+		} else if (strcmp(argv[i], "--late-input") == 0){
+			application.SetLateInputSampling(true);
+		} else if (strncmp(argv[i], "--bindings=", 11) == 0){
+			application.SetInputBindings(argv[i] + 11);
+		} else if (strncmp(argv[i], "--capture=", 10) == 0){
+			application.SetCapture(argv[i] + 10, ogre_application::CapturePng);
+		} else if (strncmp(argv[i], "--capture-raw=", 14) == 0){
+			application.SetCapture(argv[i] + 14, ogre_application::CaptureRaw);
+		} else if (strcmp(argv[i], "--offscreen") == 0){
+			application.SetOffscreen(true);
+		} else if (strncmp(argv[i], "--frames=", 9) == 0){
+			application.SetMaxFrames(atoi(argv[i] + 9));
+		} else if ((strncmp(argv[i], "--morton-sort=", 14) == 0) && (atof(argv[i] + 14) > 0.0)){
+			application.SetMortonSortPeriod((float) atof(argv[i] + 14));
+		} else if (strncmp(argv[i], "--field=", 8) == 0){
+			application.SetFieldSnapshot(argv[i] + 8);
+		} else if ((strncmp(argv[i], "--asteroids=", 12) == 0) && (atoi(argv[i] + 12) > 0)){
+			num_asteroids = atoi(argv[i] + 12);
+		} else if (strncmp(argv[i], "--seed=", 7) == 0){
+			application.SetFieldSeed((unsigned int) strtoul(argv[i] + 7, NULL, 10));
+		} else if (strcmp(argv[i], "--compact") == 0){
+			application.SetCompactState(true);
+		} else if (strcmp(argv[i], "--occlusion") == 0){
+			application.SetOcclusionCulling(true);
+		} else if (strncmp(argv[i], "--views=", 8) == 0){
+			unsigned int views = 0;
+			if (strstr(argv[i] + 8, "rear") != NULL){
+				views |= ogre_application::ViewRear;
+			}
+			if (strstr(argv[i] + 8, "tactical") != NULL){
+				views |= ogre_application::ViewTactical;
+			}
+			application.SetViews(views);
+		} else if (strcmp(argv[i], "--ship-collision=stop") == 0){
+			application.SetShipCollision(ogre_application::ShipCollisionStop);
+		} else if (strcmp(argv[i], "--ship-collision=bounce") == 0){
+			application.SetShipCollision(ogre_application::ShipCollisionBounce);
+		} else if (strcmp(argv[i], "--ship-collision=destroy") == 0){
+			application.SetShipCollision(ogre_application::ShipCollisionDestroy);
+		} else if (strcmp(argv[i], "--ship-collision=off") == 0){
+			application.SetShipCollision(ogre_application::ShipCollisionOff);
+		} else if ((strncmp(argv[i], "--alloc-check=", 14) == 0) && !ogre_application::IsAllocationTrackingAvailable()){
+			std::cerr << "Heap allocations are not tracked in this build, " << argv[i] << " needs the debug runtime" << std::endl;
+			return 1;
+		} else if (strcmp(argv[i], "--alloc-check=report") == 0){
+			ogre_application::SetAllocationCheck(ogre_application::AllocationCheckReport);
+		} else if (strcmp(argv[i], "--alloc-check=fatal") == 0){
+			ogre_application::SetAllocationCheck(ogre_application::AllocationCheckFatal);
+		} else {
+			std::cerr << "Unknown option " << argv[i] << std::endl;
+		}
+	}
 
 	try {
 		application.Init();
 		application.CreateCube();
 		//application.CreateTargetingCube();
 		application.CreateIcosahedron();
-		application.CreateAsteroidField(1500);
+		application.CreateAsteroidField(num_asteroids);
 		application.TransformAsteroidField();
 		application.MainLoop();
 	}
@@ -0,0 +1,72 @@
+#include <algorithm>
+
+#include "morton_order.h"
+
+namespace ogre_application {
+
+#define RADIX_BITS 10 // Digit size of the radix sort; three passes cover a Morton code
+#define RADIX_SIZE (1 << RADIX_BITS)
+
+
+/* Spread the low 10 bits of v so that two zero bits separate each of them */
+static unsigned int SpreadBits(unsigned int v){
+
+	v &= 0x000003FF;
+	v = (v | (v << 16)) & 0xFF0000FF;
+	v = (v | (v << 8)) & 0x0300F00F;
+	v = (v | (v << 4)) & 0x030C30C3;
+	v = (v | (v << 2)) & 0x09249249;
+	return v;
+}
+
+
+/* Grid cell of a coordinate along one axis */
+static unsigned int Quantise(float value, float min, float extent){
+
+	const float cells = (float) (1 << MORTON_BITS);
+	if (extent <= 0.0f){
+		return 0;
+	}
+	float cell = (value - min) / extent * cells;
+	return (unsigned int) std::max(0.0f, std::min(cell, cells - 1.0f));
+}
+
+
+unsigned int MortonCode(const Ogre::Vector3& pos, const Ogre::Vector3& min, const Ogre::Vector3& extent){
+
+	return SpreadBits(Quantise(pos.x, min.x, extent.x)) |
+		(SpreadBits(Quantise(pos.y, min.y, extent.y)) << 1) |
+		(SpreadBits(Quantise(pos.z, min.z, extent.z)) << 2);
+}
+
+
+void SortByMortonCode(const std::vector<unsigned int>& code, std::vector<int>& order, std::vector<int>& scratch){
+
+	int count = (int) code.size();
+	order.resize(count);
+	scratch.resize(count);
+	for (int i = 0; i < count; i++){
+		order[i] = i;
+	}
+
+	/* Least significant digit first; each pass is a stable counting sort */
+	int histogram[RADIX_SIZE];
+	for (int shift = 0; shift < 3*MORTON_BITS; shift += RADIX_BITS){
+		std::fill(histogram, histogram + RADIX_SIZE, 0);
+		for (int i = 0; i < count; i++){
+			histogram[(code[order[i]] >> shift) & (RADIX_SIZE - 1)]++;
+		}
+		int offset = 0;
+		for (int d = 0; d < RADIX_SIZE; d++){
+			int n = histogram[d];
+			histogram[d] = offset;
+			offset += n;
+		}
+		for (int i = 0; i < count; i++){
+			scratch[histogram[(code[order[i]] >> shift) & (RADIX_SIZE - 1)]++] = order[i];
+		}
+		order.swap(scratch);
+	}
+}
+
+} // namespace ogre_application;
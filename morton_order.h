@@ -0,0 +1,23 @@
+#ifndef MORTON_ORDER_H_
+#define MORTON_ORDER_H_
+
+#include <vector>
+
+#include "OGRE/OgreVector3.h"
+
+namespace ogre_application {
+
+	#define MORTON_BITS 10 // Bits per axis of a Morton code, 30 bits in total
+
+	/* Morton (Z-order) code of a position quantised to a 2^MORTON_BITS grid over the box
+	   [min, min + extent]; points close in space mostly get close codes */
+	unsigned int MortonCode(const Ogre::Vector3& pos, const Ogre::Vector3& min, const Ogre::Vector3& extent);
+
+	/* Stable sort of the indices [0, code.size()) by code: order[k] is the index that goes
+	   to position k. scratch is working memory; both vectors keep their capacity so
+	   repeated sorts do not allocate */
+	void SortByMortonCode(const std::vector<unsigned int>& code, std::vector<int>& order, std::vector<int>& scratch);
+
+} // namespace ogre_application;
+
+#endif // MORTON_ORDER_H_
@@ -0,0 +1,189 @@
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+#include <xmmintrin.h>
+
+#include "occlusion_culler.h"
+
+namespace ogre_application {
+
+OcclusionCuller::OcclusionCuller(void){
+
+	/* The levels share one block of memory */
+	size_t size = 0;
+	for (int level = 0; level < OCCLUSION_LEVELS; level++){
+		size += (OCCLUSION_WIDTH >> level) * (OCCLUSION_HEIGHT >> level);
+	}
+	memory_ = (float*) _mm_malloc(size*sizeof(float), 16);
+	float* level_start = memory_;
+	for (int level = 0; level < OCCLUSION_LEVELS; level++){
+		depth_[level] = level_start;
+		level_start += (OCCLUSION_WIDTH >> level) * (OCCLUSION_HEIGHT >> level);
+	}
+
+	projection_x_ = 1.0f;
+	projection_y_ = 1.0f;
+	offset_x_ = 0.0f;
+	offset_y_ = 0.0f;
+	near_distance_ = 0.0f;
+}
+
+
+OcclusionCuller::~OcclusionCuller(void){
+
+	_mm_free(memory_);
+}
+
+
+void OcclusionCuller::Begin(const Ogre::Camera* camera){
+
+	/* OGRE projection matrices are in the OpenGL convention, looking down -z */
+	view_ = camera->getViewMatrix();
+	const Ogre::Matrix4& projection = camera->getProjectionMatrix();
+	projection_x_ = projection[0][0];
+	projection_y_ = projection[1][1];
+	offset_x_ = projection[0][2];
+	offset_y_ = projection[1][2];
+	near_distance_ = camera->getNearClipDistance();
+
+	__m128 far_depth = _mm_set1_ps(FLT_MAX);
+	for (int i = 0; i < OCCLUSION_WIDTH*OCCLUSION_HEIGHT; i += 4){
+		_mm_store_ps(depth_[0] + i, far_depth);
+	}
+}
+
+
+bool OcclusionCuller::DrawOccluder(const Ogre::Vector3& centre, float inner_radius){
+
+	Ogre::Vector3 view_centre = view_.transformAffine(centre);
+	float depth = -view_centre.z;
+	if (depth - inner_radius <= near_distance_){
+		return false;
+	}
+
+	/* Seen from the camera, the solid sphere covers at least the disc of radius
+	   inner_radius / distance around the direction of its centre */
+	float half = 0.70710678f * inner_radius / view_centre.length();
+	float centre_x = view_centre.x / depth;
+	float centre_y = view_centre.y / depth;
+	float left_edge = ((projection_x_*(centre_x - half) - offset_x_)*0.5f + 0.5f) * OCCLUSION_WIDTH;
+	float right_edge = ((projection_x_*(centre_x + half) - offset_x_)*0.5f + 0.5f) * OCCLUSION_WIDTH;
+	float top_edge = (0.5f - (projection_y_*(centre_y + half) - offset_y_)*0.5f) * OCCLUSION_HEIGHT;
+	float bottom_edge = (0.5f - (projection_y_*(centre_y - half) - offset_y_)*0.5f) * OCCLUSION_HEIGHT;
+
+	/* Only texels the square covers entirely */
+	int left = std::max(0, (int) ceil(left_edge));
+	int right = std::min(OCCLUSION_WIDTH, (int) floor(right_edge));
+	int top = std::max(0, (int) ceil(top_edge));
+	int bottom = std::min(OCCLUSION_HEIGHT, (int) floor(bottom_edge));
+	if ((right - left < 2) || (bottom - top < 2)){
+		return false;
+	}
+
+	/* No point of the sphere is farther than this along the view direction */
+	float occluder_depth = depth + inner_radius;
+	__m128 occluder_depth4 = _mm_set1_ps(occluder_depth);
+	for (int y = top; y < bottom; y++){
+		float* row = depth_[0] + y*OCCLUSION_WIDTH;
+		int x = left;
+		for (; x + 4 <= right; x += 4){
+			_mm_storeu_ps(row + x, _mm_min_ps(_mm_loadu_ps(row + x), occluder_depth4));
+		}
+		for (; x < right; x++){
+			row[x] = std::min(row[x], occluder_depth);
+		}
+	}
+	return true;
+}
+
+
+void OcclusionCuller::BuildHierarchy(void){
+
+	for (int level = 1; level < OCCLUSION_LEVELS; level++){
+		const float* source = depth_[level - 1];
+		float* target = depth_[level];
+		int source_width = OCCLUSION_WIDTH >> (level - 1);
+		int width = OCCLUSION_WIDTH >> level;
+		int height = OCCLUSION_HEIGHT >> level;
+
+		for (int y = 0; y < height; y++){
+			const float* row0 = source + (2*y)*source_width;
+			const float* row1 = row0 + source_width;
+			float* out = target + y*width;
+			int x = 0;
+
+			/* Eight source texels of two rows give four target texels */
+			for (; x + 4 <= width; x += 4){
+				__m128 a = _mm_max_ps(_mm_load_ps(row0 + 2*x), _mm_load_ps(row1 + 2*x));
+				__m128 b = _mm_max_ps(_mm_load_ps(row0 + 2*x + 4), _mm_load_ps(row1 + 2*x + 4));
+				__m128 even = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+				__m128 odd = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+				_mm_store_ps(out + x, _mm_max_ps(even, odd));
+			}
+			for (; x < width; x++){
+				out[x] = std::max(std::max(row0[2*x], row0[2*x + 1]), std::max(row1[2*x], row1[2*x + 1]));
+			}
+		}
+	}
+}
+
+
+bool OcclusionCuller::ScreenBounds(float x_min, float x_max, float y_min, float y_max, float near_depth, float far_depth,
+	int& left, int& top, int& right, int& bottom) const {
+
+	/* Over the box, x / depth is extreme at one of its corners */
+	float ratio_x_min = std::min(x_min / near_depth, x_min / far_depth);
+	float ratio_x_max = std::max(x_max / near_depth, x_max / far_depth);
+	float ratio_y_min = std::min(y_min / near_depth, y_min / far_depth);
+	float ratio_y_max = std::max(y_max / near_depth, y_max / far_depth);
+
+	left = (int) floor(((projection_x_*ratio_x_min - offset_x_)*0.5f + 0.5f) * OCCLUSION_WIDTH);
+	right = (int) floor(((projection_x_*ratio_x_max - offset_x_)*0.5f + 0.5f) * OCCLUSION_WIDTH);
+	top = (int) floor((0.5f - (projection_y_*ratio_y_max - offset_y_)*0.5f) * OCCLUSION_HEIGHT);
+	bottom = (int) floor((0.5f - (projection_y_*ratio_y_min - offset_y_)*0.5f) * OCCLUSION_HEIGHT);
+	if ((right < 0) || (left >= OCCLUSION_WIDTH) || (bottom < 0) || (top >= OCCLUSION_HEIGHT)){
+		return false;
+	}
+
+	left = std::max(left, 0);
+	right = std::min(right, OCCLUSION_WIDTH - 1);
+	top = std::max(top, 0);
+	bottom = std::min(bottom, OCCLUSION_HEIGHT - 1);
+	return true;
+}
+
+
+bool OcclusionCuller::IsOccluded(const Ogre::Vector3& centre, float radius) const {
+
+	Ogre::Vector3 view_centre = view_.transformAffine(centre);
+	float near_depth = -view_centre.z - radius;
+	if (near_depth <= near_distance_){
+		return false;
+	}
+
+	int left, top, right, bottom;
+	if (!ScreenBounds(view_centre.x - radius, view_centre.x + radius, view_centre.y - radius, view_centre.y + radius,
+		near_depth, -view_centre.z + radius, left, top, right, bottom)){
+		return false;
+	}
+
+	/* Finest level where the rectangle covers at most 8x8 texels */
+	int level = 0;
+	while ((level < OCCLUSION_LEVELS - 1) &&
+		(((right >> level) - (left >> level) > 7) || ((bottom >> level) - (top >> level) > 7))){
+		level++;
+	}
+
+	/* Hidden only if every texel holds something nearer than the sphere */
+	int width = OCCLUSION_WIDTH >> level;
+	for (int y = top >> level; y <= (bottom >> level); y++){
+		for (int x = left >> level; x <= (right >> level); x++){
+			if (depth_[level][y*width + x] >= near_depth){
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+} // namespace ogre_application;
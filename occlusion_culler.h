@@ -0,0 +1,59 @@
+#ifndef OCCLUSION_CULLER_H_
+#define OCCLUSION_CULLER_H_
+
+#include "OGRE/OgreCamera.h"
+#include "OGRE/OgreMatrix4.h"
+
+namespace ogre_application {
+
+	/* Resolution of the software depth buffer; the width is a multiple of eight for SIMD */
+	#define OCCLUSION_WIDTH 256
+	#define OCCLUSION_HEIGHT 128
+	#define OCCLUSION_LEVELS 8 // Depth pyramid levels, down to 2x1 texels
+
+	/* Software occlusion culling at low resolution. Occluders are drawn into a depth
+	   buffer as screen-aligned squares inscribed in the projection of a sphere that
+	   is solid, so they never cover more than the real object. A pyramid of the
+	   farthest depth of each 2x2 block then lets a bounding sphere be tested against
+	   a handful of texels */
+	class OcclusionCuller {
+
+		public:
+			OcclusionCuller(void);
+			~OcclusionCuller(void);
+
+			/* Clear the depth buffer and take the view and projection of the camera */
+			void Begin(const Ogre::Camera* camera);
+
+			/* Draw an occluder that is solid within inner_radius of its centre; returns
+			   false if it is too small on screen or too close to be of use */
+			bool DrawOccluder(const Ogre::Vector3& centre, float inner_radius);
+
+			/* Build the depth pyramid; call after drawing the occluders */
+			void BuildHierarchy(void);
+
+			/* Whether a sphere lies entirely behind the occluders */
+			bool IsOccluded(const Ogre::Vector3& centre, float radius) const;
+
+		private:
+			float* depth_[OCCLUSION_LEVELS]; // Largest view depth of each texel, level 0 first
+			float* memory_;
+
+			/* Camera of the current frame */
+			Ogre::Matrix4 view_;
+			float projection_x_; // Scale of x over depth in normalised device coordinates
+			float projection_y_;
+			float offset_x_; // Shift of an off-centre projection
+			float offset_y_;
+			float near_distance_;
+
+			/* Rectangle of texels covered by the projection of a view-space box; false
+			   when it is off screen */
+			bool ScreenBounds(float x_min, float x_max, float y_min, float y_max, float near_depth, float far_depth,
+				int& left, int& top, int& right, int& bottom) const;
+
+	}; // class OcclusionCuller
+
+} // namespace ogre_application;
+
+#endif // OCCLUSION_CULLER_H_
@@ -1,3 +1,21 @@
+#include <iostream>
+#include <fstream>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
+#include "OGRE/OgreResourceBackgroundQueue.h"
+#include "OGRE/OgreGpuProgramManager.h"
+#include "OGRE/OgreDataStream.h"
+#include "OGRE/OgreLogManager.h"
+#include "OGRE/OgreWorkQueue.h"
+
 #include "ogre_application.h"
 #include "bin/path_config.h"
 
@@ -18,6 +36,15 @@ const unsigned int window_width_g = 800;
 const unsigned int window_height_g = 600;
 const bool window_full_screen_g = false;
 
+/* Frame pacing */
+const unsigned long long frame_spin_time_g = 2000; // Microseconds before a frame is due when sleeping turns into spinning
+const unsigned long long latency_report_period_g = 5000000; // Microseconds between latency reports
+
+/* Input and simulation steps */
+const int input_rate_g = 1000; // Keyboard and mouse captures per second
+const unsigned long long simulation_step_g = 16667; // Microseconds of a simulation step; the controls are tuned for 60 steps per second
+const unsigned long long max_steps_per_frame_g = 8; // Steps run at most to catch up after a stall
+
 /* Viewport and camera settings */
 float viewport_width_g = 0.95f;
 float viewport_height_g = 0.95f;
@@ -30,14 +57,212 @@ float camera_far_clip_distance_g = 5000.0;
 Ogre::Vector3 camera_position_g(0.0, -10.0, 800.0);
 Ogre::Vector3 camera_look_at_g(0.0, 0.0, 0.0);
 Ogre::Vector3 camera_up_g(0.0, 1.0, 0.0);
+
+/* Extra views, drawn as insets over the pilot view */
+const Ogre::String secondary_view_scheme_g = "SecondaryView"; // Material scheme of the views the dynamic lights are not binned for
+float rear_viewport_width_g = 0.4f;
+float rear_viewport_height_g = 0.2f;
+float rear_viewport_left_g = (1.0f - rear_viewport_width_g) * 0.5f;
+float rear_viewport_top_g = viewport_top_g + 0.02f;
+unsigned short rear_viewport_z_order_g = 101;
+float rear_camera_far_clip_distance_g = 300.0; // Only what is close behind matters
+float tactical_viewport_width_g = 0.3f;
+float tactical_viewport_height_g = 0.3f;
+float tactical_viewport_left_g = viewport_left_g + viewport_width_g - tactical_viewport_width_g - 0.02f;
+float tactical_viewport_top_g = viewport_top_g + viewport_height_g - tactical_viewport_height_g - 0.02f;
+unsigned short tactical_viewport_z_order_g = 102;
+Ogre::Vector3 tactical_camera_position_g(0.0, 700.0, 1100.0);
+Ogre::Vector3 tactical_camera_look_at_g(0.0, 0.0, 300.0);
  
 /* Materials */
 const Ogre::String material_directory_g = MATERIAL_DIRECTORY;
+const Ogre::String microcode_cache_filename_g = "microcode.cache"; // Compiled GPU programs kept between runs
+const Ogre::String font_directory_g = FONT_DIRECTORY; // TrueType fonts of the Ogre media
+
+/* Asteroid field */
+const float asteroid_radius_g = ASTEROID_RADIUS; // Bounding radius of the asteroid mesh
+const int max_materialise_per_frame_g = 2000; // Asteroids that can get scene objects in one update
+const float asteroid_inner_radius_g = 0.79; // Radius of the sphere inside the asteroid mesh
+const size_t max_occluders_g = 64; // Nearest asteroids drawn into the occlusion buffer
+const float grid_cell_size_g = GRID_CELL_SIZE; // Cell size of the collision grid
+
+/* Ship */
+const float ship_radius_g = SHIP_RADIUS; // Bounding radius of the ship around the camera
+const float ship_restitution_g = 0.5; // Fraction of the speed into an asteroid kept by a bounce
+const int max_ship_contacts_g = 4; // Contacts handled in one step before the ship is held in place
+
+/* Dynamic lights */
+const Ogre::String lit_material_name_g = "ObjectMaterial"; // Material that receives the clustered lights
+const Ogre::ColourValue laser_light_colour_g(1.0, 0.1, 0.1);
+const float laser_light_radius_g = 15.0;
+const int num_laser_lights_g = 8; // Lights placed along the front half of the beam
+const Ogre::ColourValue hit_light_colour_g(1.0, 0.9, 0.6);
+const float hit_light_radius_g = 20.0;
+const float hit_light_life_g = 0.15;
+const Ogre::ColourValue explosion_light_colour_g(1.0, 0.5, 0.1);
+const float explosion_light_radius_g = 60.0;
+const float explosion_light_life_g = 1.0;
+
+/* Memory */
+const size_t frame_arena_capacity_g = 1 << 20; // Initial size of the per-frame arena; it grows to the peak frame
+const int allocation_warmup_frames_g = 120; // Frames before the loop is expected to stop allocating
+
+/* Particles */
+const int worker_threads_g = 0; // Threads helping with per-frame work; zero uses all but one core
+const int sparks_per_hit_g = 60;
+const int debris_per_explosion_g = 200;
+
+
+/* Default progress report for resource loading */
+static void PrintLoadingProgress(float progress, const Ogre::String& stage){
+
+	std::cout << "Loading " << int(progress*100.0f) << "% " << stage << std::endl;
+}
 
 
 OgreApplication::OgreApplication(void){
 
     /* Don't do work in the constructor, leave it for the Init() function */
+	loading_progress_callback_ = PrintLoadingProgress;
+	frame_pacing_ = VSync;
+	max_fps_ = 60.0f;
+	late_input_sampling_ = false;
+	capture_format_ = CapturePng;
+	offscreen_ = false;
+	max_frames_ = 0;
+	morton_sort_period_ = 0.0f;
+	morton_sort_timer_ = 0.0f;
+	asteroid_ = NULL;
+	field_seed_ = 1; // What rand() uses without srand()
+	compact_state_ = false;
+	spin_steps_ = 0;
+	occlusion_culling_ = false;
+	ship_collision_ = ShipCollisionStop;
+	extra_views_ = 0;
+}
+
+
+void OgreApplication::SetFramePacing(FramePacing pacing, float max_fps){
+
+	frame_pacing_ = pacing;
+	max_fps_ = max_fps;
+}
+
+
+void OgreApplication::SetInputBindings(const Ogre::String& filename){
+
+	bindings_filename_ = filename;
+}
+
+
+void OgreApplication::SetLateInputSampling(bool late){
+
+	late_input_sampling_ = late;
+}
+
+
+void OgreApplication::SetFieldSnapshot(const Ogre::String& filename){
+
+	field_filename_ = filename;
+}
+
+
+void OgreApplication::SetFieldSeed(unsigned int seed){
+
+	field_seed_ = seed;
+}
+
+
+void OgreApplication::SetCompactState(bool compact){
+
+	compact_state_ = compact;
+}
+
+
+void OgreApplication::SetOcclusionCulling(bool occlusion){
+
+	occlusion_culling_ = occlusion;
+}
+
+
+void OgreApplication::SetShipCollision(ShipCollision response){
+
+	ship_collision_ = response;
+}
+
+
+void OgreApplication::SetMortonSortPeriod(float seconds){
+
+	morton_sort_period_ = seconds;
+}
+
+
+void OgreApplication::SetCapture(const Ogre::String& directory, CaptureFormat format){
+
+	capture_directory_ = directory;
+	capture_format_ = format;
+}
+
+
+void OgreApplication::SetOffscreen(bool offscreen){
+
+	offscreen_ = offscreen;
+}
+
+
+void OgreApplication::SetMaxFrames(int max_frames){
+
+	max_frames_ = max_frames;
+}
+
+
+void OgreApplication::SetViews(unsigned int views){
+
+	extra_views_ = views;
+}
+
+
+void OgreApplication::SetLoadingProgressCallback(LoadingProgressCallback callback){
+
+	loading_progress_callback_ = callback;
+}
+
+
+void OgreApplication::MarkStartupStage(const Ogre::String& stage){
+
+	/* Charge the time since the previous mark to the stage; repeated stages add up */
+	unsigned long elapsed = startup_timer_.getMicroseconds();
+	startup_timer_.reset();
+
+	for (size_t i = 0; i < startup_stages_.size(); i++){
+		if (startup_stages_[i].first == stage){
+			startup_stages_[i].second += elapsed;
+			return;
+		}
+	}
+	startup_stages_.push_back(std::make_pair(stage, elapsed));
+}
+
+
+void OgreApplication::LogStartupTimes(void){
+
+	unsigned long total = 0;
+	for (size_t i = 0; i < startup_stages_.size(); i++){
+		total += startup_stages_[i].second;
+	}
+
+	std::ostringstream report;
+	report << "Startup time: " << total / 1000.0 << " ms" << std::endl;
+	for (size_t i = 0; i < startup_stages_.size(); i++){
+		report << "  " << startup_stages_[i].first << ": " << startup_stages_[i].second / 1000.0 << " ms";
+		if (total > 0){
+			report << " (" << (100 * startup_stages_[i].second) / total << "%)";
+		}
+		report << std::endl;
+	}
+
+	std::cout << report.str();
+	Ogre::LogManager::getSingleton().logMessage(report.str());
 }
 
 
@@ -45,7 +270,14 @@ void OgreApplication::Init(void){
 
 	/* Set default values for the variables */
 	animating_ = true;
-	space_down_ = false;
+	save_requested_ = false;
+	for (int a = 0; a < NUM_ACTIONS; a++){
+		action_keys_down_[a] = 0;
+		action_down_time_[a] = 0;
+	}
+	step_time_ = 0;
+	collision_time_ = 0;
+	ship_contacts_.reserve(max_ship_contacts_g); // MoveShip() runs in the steady state
 
 	input_manager_ = NULL;
 	keyboard_ = NULL;
@@ -54,17 +286,37 @@ void OgreApplication::Init(void){
 	/* Camera demo */
 	last_dir_ = Direction::Forward;
 	num_asteroids_ = 0;
+	num_visible_asteroids_ = 0;
 	counter = 0;
+	next_frame_time_ = 0;
+	input_sample_time_ = 0;
+	latency_sum_ = 0;
+	latency_max_ = 0;
+	latency_frames_ = 0;
+	latency_period_start_ = 0;
 	dirction = Ogre::Vector3(0,0,0);
 	/* Run all initialization steps */
+	startup_timer_.reset();
+	worker_pool_.Init(worker_threads_g);
+	frame_arena_.Init(frame_arena_capacity_g);
     InitRootNode();
+	MarkStartupStage("root init");
     InitPlugins();
+	MarkStartupStage("plugins");
     InitRenderSystem();
     InitWindow();
+	MarkStartupStage("window");
     InitViewport();
+	InitViews();
 	InitEvents();
 	InitOIS();
+	MarkStartupStage("viewport and input");
 	LoadMaterials();
+	InitLighting();
+	InitParticles();
+	InitCapture();
+	InitPerfHud();
+	MarkStartupStage("resources");
 }
 
 
@@ -74,6 +326,9 @@ void OgreApplication::InitRootNode(void){
 		
 		/* We need to have an Ogre root to be able to access all Ogre functions */
         ogre_root_ = std::auto_ptr<Ogre::Root>(new Ogre::Root(config_filename_g, plugins_filename_g, log_filename_g));
+
+		/* The overlay and font managers must exist before any resources are loaded */
+		overlay_system_ = std::auto_ptr<Ogre::OverlaySystem>(new Ogre::OverlaySystem());
 		//ogre_root_->showConfigDialog();
 
     }
@@ -147,7 +402,11 @@ void OgreApplication::InitWindow(void){
 
         Ogre::NameValuePairList params;
         params["FSAA"] = "0";
-        params["vsync"] = "true";
+        params["vsync"] = ((frame_pacing_ == VSync) && !offscreen_) ? "true" : "false";
+		if (offscreen_){
+			/* The window only provides the GL context */
+			params["hidden"] = "true";
+		}
         ogre_window_ = ogre_root_->createRenderWindow(window_title_g, window_width_g, window_height_g, window_full_screen_g, &params);
 
         ogre_window_->setActive(true);
@@ -170,6 +429,9 @@ void OgreApplication::InitViewport(void){
         Ogre::SceneManager* scene_manager = ogre_root_->createSceneManager(Ogre::ST_GENERIC, "MySceneManager");
         Ogre::SceneNode* root_scene_node = scene_manager->getRootSceneNode();
 
+		/* Draw overlays on top of the scene */
+		scene_manager->addRenderQueueListener(overlay_system_.get());
+
         /* Create camera object */
         Ogre::Camera* camera = scene_manager->createCamera("MyCamera");
         Ogre::SceneNode* camera_scene_node = root_scene_node->createChildSceneNode("MyCameraNode");
@@ -201,6 +463,65 @@ void OgreApplication::InitViewport(void){
 }
 
 
+/* Settings shared by the views drawn over the pilot view */
+static void InitInset(Ogre::Viewport* viewport, Ogre::Camera* camera){
+
+	viewport->setAutoUpdated(true);
+	viewport->setBackgroundColour(viewport_background_color_g);
+
+	/* The HUD belongs to the pilot view, and the dynamic lights are binned for the
+	   pilot camera, so the insets are drawn without either */
+	viewport->setOverlaysEnabled(false);
+	viewport->setMaterialScheme(secondary_view_scheme_g);
+
+	float ratio = float(viewport->getActualWidth()) / float(viewport->getActualHeight());
+	camera->setAspectRatio(ratio);
+}
+
+
+void OgreApplication::InitViews(void){
+
+	try {
+
+		/* The pilot view is the first, so it has the lowest bit in the view masks */
+		Ogre::SceneManager* scene_manager = ogre_root_->getSceneManager("MySceneManager");
+		view_culler_.AddView(scene_manager->getCamera("MyCamera"));
+
+		/* The rear camera is moved with the pilot camera by UpdateViews() */
+		if (extra_views_ & ViewRear){
+			Ogre::Camera* camera = scene_manager->createCamera("RearCamera");
+			camera->setNearClipDistance(camera_near_clip_distance_g);
+			camera->setFarClipDistance(rear_camera_far_clip_distance_g);
+
+			Ogre::Viewport* viewport = ogre_window_->addViewport(camera, rear_viewport_z_order_g, rear_viewport_left_g, rear_viewport_top_g, rear_viewport_width_g, rear_viewport_height_g);
+			InitInset(viewport, camera);
+			view_culler_.AddView(camera);
+		}
+
+		if (extra_views_ & ViewTactical){
+			Ogre::Camera* camera = scene_manager->createCamera("TacticalCamera");
+			camera->setNearClipDistance(camera_near_clip_distance_g);
+			camera->setFarClipDistance(camera_far_clip_distance_g);
+			camera->setPosition(tactical_camera_position_g);
+			camera->lookAt(tactical_camera_look_at_g);
+
+			Ogre::Viewport* viewport = ogre_window_->addViewport(camera, tactical_viewport_z_order_g, tactical_viewport_left_g, tactical_viewport_top_g, tactical_viewport_width_g, tactical_viewport_height_g);
+			InitInset(viewport, camera);
+			view_culler_.AddView(camera);
+		}
+
+		/* Bound the views for the field created before the first frame */
+		UpdateViews();
+	}
+    catch (Ogre::Exception &e){
+        throw(OgreAppException(std::string("Ogre::Exception: ") + std::string(e.what())));
+    }
+    catch(std::exception &e){
+        throw(OgreAppException(std::string("std::Exception: ") + std::string(e.what())));
+    }
+}
+
+
 void OgreApplication::InitEvents(void){
 
 	try {
@@ -243,8 +564,9 @@ void OgreApplication::InitOIS(void){
 		ogre_window_->getCustomAttribute("WINDOW", &hWnd);
 		input_manager_ = OIS::InputManager::createInputSystem(hWnd);*/
 
-		/* Initialize keyboard and mouse */
-		keyboard_ = static_cast<OIS::Keyboard*>(input_manager_->createInputObject(OIS::OISKeyboard, false));
+		/* Initialize keyboard and mouse; the keyboard is buffered so the input thread
+		   sees every key event */
+		keyboard_ = static_cast<OIS::Keyboard*>(input_manager_->createInputObject(OIS::OISKeyboard, true));
 
 		mouse_ = static_cast<OIS::Mouse*>(input_manager_->createInputObject(OIS::OISMouse, false));
 		unsigned int width, height, depth;
@@ -254,6 +576,14 @@ void OgreApplication::InitOIS(void){
 		ms.width = width;
 		ms.height = height;
 
+		/* Controls come from the binding file if there is one */
+		if (!bindings_filename_.empty() && !action_table_.Load(bindings_filename_, keyboard_)){
+			Ogre::LogManager::getSingleton().logMessage("Could not read " + bindings_filename_ + ", using the default controls");
+		}
+
+		/* From now on only the input thread reads the devices */
+		input_thread_.Start(keyboard_, mouse_, input_rate_g);
+
 	}
     catch(std::exception &e){
         throw(OgreAppException(std::string("std::Exception: ") + std::string(e.what())));
@@ -261,6 +591,21 @@ void OgreApplication::InitOIS(void){
 }
 
 
+/* Wait for a request of the background queue, reporting progress and keeping the window alive */
+static void WaitForBackgroundTask(Ogre::Root* root, Ogre::ResourceBackgroundQueue& queue, Ogre::BackgroundProcessTicket ticket, ResourceLoadingListener& listener){
+
+	/* Without thread support in OGRE the request has already completed */
+	while (!queue.isProcessComplete(ticket)){
+		/* Completed requests are only acknowledged when their responses are processed */
+		root->getWorkQueue()->processResponses();
+		listener.ReportProgress();
+		Ogre::WindowEventUtilities::messagePump();
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	listener.ReportProgress();
+}
+
+
 void OgreApplication::LoadMaterials(void){
 
     try {
@@ -271,8 +616,140 @@ void OgreApplication::LoadMaterials(void){
 		resource_group_manager.createResourceGroup(resource_group_name);
 		bool is_recursive = false;
 		resource_group_manager.addResourceLocation(material_directory_g, "FileSystem", resource_group_name, is_recursive);
-		resource_group_manager.initialiseResourceGroup(resource_group_name);
+
+		/* Reuse the programs compiled by earlier runs instead of compiling the GLSL sources */
+		LoadMicrocodeCache();
+
+		/* Parse the scripts and read the resource files in the background; the window keeps
+		   processing its messages meanwhile */
+		ResourceLoadingListener listener(loading_progress_callback_);
+		resource_group_manager.addResourceGroupListener(&listener);
+		Ogre::ResourceBackgroundQueue& background_queue = Ogre::ResourceBackgroundQueue::getSingleton();
+		WaitForBackgroundTask(ogre_root_.get(), background_queue, background_queue.initialiseResourceGroup(resource_group_name), listener);
+		WaitForBackgroundTask(ogre_root_.get(), background_queue, background_queue.prepareResourceGroup(resource_group_name), listener);
+
+		/* GPU objects can only be created on the thread that owns the GL context */
 		resource_group_manager.loadResourceGroup(resource_group_name);
+		resource_group_manager.removeResourceGroupListener(&listener);
+
+	}
+    catch (Ogre::Exception &e){
+        throw(OgreAppException(std::string("Ogre::Exception: ") + std::string(e.what())));
+    }
+    catch(std::exception &e){
+        throw(OgreAppException(std::string("std::Exception: ") + std::string(e.what())));
+    }
+}
+
+
+void OgreApplication::LoadMicrocodeCache(void){
+
+	/* Some render systems cannot hand back compiled programs; RenderSystem_GL, which
+	   this application loads, is one of them, so with it the cache is never used */
+	Ogre::GpuProgramManager& program_manager = Ogre::GpuProgramManager::getSingleton();
+	if (!program_manager.canGetCompiledShaderBuffer()){
+		Ogre::LogManager::getSingleton().logMessage("Microcode cache unavailable: " + ogre_root_->getRenderSystem()->getName() +
+			" cannot return compiled programs, so every GLSL program is compiled from source at startup and " +
+			microcode_cache_filename_g + " is neither read nor written");
+		return;
+	}
+	program_manager.setSaveMicrocodesToCache(true);
+
+	std::fstream file(microcode_cache_filename_g.c_str(), std::ios::in | std::ios::binary);
+	if (file.is_open()){
+		Ogre::DataStreamPtr stream(OGRE_NEW Ogre::FileStreamDataStream(&file, false));
+		program_manager.loadMicrocodeCache(stream);
+		Ogre::LogManager::getSingleton().logMessage("Microcode cache loaded from " + microcode_cache_filename_g);
+	} else {
+		Ogre::LogManager::getSingleton().logMessage("Microcode cache " + microcode_cache_filename_g + " not found; it is written at exit");
+	}
+}
+
+
+void OgreApplication::SaveMicrocodeCache(void){
+
+	/* Programs are linked when first rendered, so the cache is only complete after the main loop */
+	Ogre::GpuProgramManager& program_manager = Ogre::GpuProgramManager::getSingleton();
+	if (!program_manager.getSaveMicrocodesToCache() || !program_manager.isCacheDirty()){
+		return;
+	}
+
+	std::fstream file(microcode_cache_filename_g.c_str(), std::ios::out | std::ios::binary);
+	if (file.is_open()){
+		Ogre::DataStreamPtr stream(OGRE_NEW Ogre::FileStreamDataStream(&file, false));
+		program_manager.saveMicrocodeCache(stream);
+	}
+}
+
+
+void OgreApplication::InitLighting(void){
+
+	try {
+
+		/* Set up the cluster grid of the camera and bind the light lists to the material */
+		AllocationScope scope(AllocLights);
+		Ogre::SceneManager* scene_manager = ogre_root_->getSceneManager("MySceneManager");
+		Ogre::Camera* camera = scene_manager->getCamera("MyCamera");
+		light_clusters_.Init(lit_material_name_g, camera);
+
+	}
+    catch (Ogre::Exception &e){
+        throw(OgreAppException(std::string("Ogre::Exception: ") + std::string(e.what())));
+    }
+    catch(std::exception &e){
+        throw(OgreAppException(std::string("std::Exception: ") + std::string(e.what())));
+    }
+}
+
+
+void OgreApplication::InitParticles(void){
+
+	try {
+
+		/* Preallocate the particle pool and its vertex buffers */
+		AllocationScope scope(AllocParticles);
+		Ogre::SceneManager* scene_manager = ogre_root_->getSceneManager("MySceneManager");
+		particles_.Init(scene_manager, &worker_pool_);
+
+	}
+    catch (Ogre::Exception &e){
+        throw(OgreAppException(std::string("Ogre::Exception: ") + std::string(e.what())));
+    }
+    catch(std::exception &e){
+        throw(OgreAppException(std::string("std::Exception: ") + std::string(e.what())));
+    }
+}
+
+
+void OgreApplication::InitPerfHud(void){
+
+	try {
+
+		/* The HUD starts hidden; without its font it stays disabled */
+		AllocationScope scope(AllocHud);
+		perf_hud_.Init(&worker_pool_, font_directory_g);
+
+	}
+    catch (Ogre::Exception &e){
+        throw(OgreAppException(std::string("Ogre::Exception: ") + std::string(e.what())));
+    }
+    catch(std::exception &e){
+        throw(OgreAppException(std::string("std::Exception: ") + std::string(e.what())));
+    }
+}
+
+
+void OgreApplication::InitCapture(void){
+
+	try {
+
+		/* Render the camera view to a texture of the window size as well */
+		AllocationScope scope(AllocCapture);
+		if (!capture_directory_.empty()){
+			Ogre::SceneManager* scene_manager = ogre_root_->getSceneManager("MySceneManager");
+			Ogre::Camera* camera = scene_manager->getCamera("MyCamera");
+			capture_.Init(camera, window_width_g, window_height_g, capture_directory_, capture_format_);
+		}
 
 	}
     catch (Ogre::Exception &e){
@@ -465,6 +942,7 @@ void OgreApplication::CreateCube(void){
         /* Convert triangle list to a mesh */
         Ogre::String mesh_name = "Cube";
         object->convertToMesh(mesh_name);
+		MarkStartupStage("mesh build");
 
 	}
     catch (Ogre::Exception &e){
@@ -493,37 +971,18 @@ void OgreApplication::CreateIcosahedron(void){
 		Ogre::String material_name = "ObjectMaterial";
         object->begin(material_name, Ogre::RenderOperation::OT_TRIANGLE_LIST);
 
-		/* Vertices of an icosahedron */
-		#define X 0.525731112119133606
-		#define Z 0.850650808352039932
-        static float vdata[12][3] = {
-	        {-X, 0.0, Z}, {X, 0.0, Z}, {-X, 0.0, -Z}, {X, 0.0, -Z},
-	        {0.0, Z, X}, {0.0, Z, -X}, {0.0, -Z, X}, {0.0, -Z, -X},
-	        {Z, X, 0.0}, {-Z, X, 0.0}, {Z, -X, 0.0}, {-Z, -X, 0.0}};
- 
-		/* Vertex colors */
-		static float clr[12][3] = {
-			{1.0, 0.0, 0.0}, {0.0, 1.0, 0.0}, {0.0, 0.0, 1.0}, {1.0, 1.0, 0.0},
-			{1.0, 0.0, 1.0}, {0.0, 1.0, 1.0}, {1.0, 1.0, 1.0}, {0.6, 0.4, 0.2},
-			{1.0, 0.2, 0.8}, {1.0, 0.4, 0.0}, {0.0, 0.6, 0.0}, {0.6, 0.6, 0.6}};
-
-        /* Faces */
-        static int tindices [20][3] = {
-	        {1, 4, 0}, {4, 9, 0}, {4, 5, 9}, {8, 5, 4},	{1, 8, 4}, 
-	        {1, 10, 8}, {10, 3, 8}, {8, 3, 5}, {3, 2, 5}, {3, 7, 2}, 
-	        {3, 10, 7}, {10, 6, 7}, {6, 11, 7}, {6, 0, 11},	{6, 1, 0}, 
-	        {10, 1, 6}, {11, 0, 9}, {2, 11, 9}, {5, 2, 9}, {11, 2, 7}, 
-        };
-		
-		/* Add vertices and faces */
-		for (int i = 0; i < 12; i++){
-			object->position(Ogre::Vector3(vdata[i][0], vdata[i][1], vdata[i][2]));
-			object->normal(Ogre::Vector3(vdata[i][0], vdata[i][1], vdata[i][2]));
-			object->colour(Ogre::ColourValue(clr[i][0], clr[i][1], clr[i][2]));
+		/* Add vertices and faces; the mesh is shared with the benchmarks */
+		AsteroidVertex vertex[ASTEROID_MESH_VERTICES];
+		int index[3*ASTEROID_MESH_TRIANGLES];
+		BuildAsteroidMesh(vertex, index);
+		for (int i = 0; i < ASTEROID_MESH_VERTICES; i++){
+			object->position(vertex[i].position);
+			object->normal(vertex[i].normal);
+			object->colour(vertex[i].colour);
 		}
 
-		for (int i = 0; i < 20; i++){
-			object->triangle(tindices[i][0], tindices[i][1], tindices[i][2]);
+		for (int i = 0; i < ASTEROID_MESH_TRIANGLES; i++){
+			object->triangle(index[3*i], index[3*i + 1], index[3*i + 2]);
 		}
    
 		/* We finished the object */
@@ -532,6 +991,7 @@ void OgreApplication::CreateIcosahedron(void){
         /* Convert triangle list to a mesh */
         Ogre::String mesh_name = "Icosahedron";
         object->convertToMesh(mesh_name);
+		MarkStartupStage("mesh build");
 
 	}
     catch (Ogre::Exception &e){
@@ -548,18 +1008,73 @@ void OgreApplication::MainLoop(void){
     try {
 
         /* Main loop to keep the application going */
+		LogStartupTimes();
 
         ogre_root_->clearEventTimes();
+#if defined(_WIN32)
+		/* Let Sleep() wake up within a millisecond for the frame limiter */
+		timeBeginPeriod(1);
+#endif
+		next_frame_time_ = ogre_root_->getTimer()->getMicroseconds();
+		latency_period_start_ = next_frame_time_;
+		input_sample_time_ = next_frame_time_;
+		step_time_ = InputThread::Now();
+		int frames = 0;
 
         while(!ogre_window_->isClosed()){
-            ogre_window_->update(false);
-
-            ogre_window_->swapBuffers();
+			/* Close the counts of the frame before and report now and then; reports, the
+			   HUD text and saves requested with F5 allocate, so they stay outside the part
+			   of the loop that must not */
+			NextAllocationFrame();
+			ReportFrameStatistics();
+			{
+				AllocationScope scope(AllocHud);
+				perf_hud_.PresentCaption();
+			}
+			if (save_requested_){
+				/* Copies the field into the writer's buffer and starts its thread */
+				save_requested_ = false;
+				SaveAsteroidField();
+			}
+			NoAllocationScope steady_state(frames >= allocation_warmup_frames_g);
+
+			if (frame_pacing_ == FrameLimited){
+				WaitForNextFrame();
+			}
+
+			/* In low latency mode the camera moves with input sampled just before rendering */
+			if (late_input_sampling_ && !ProcessInput()){
+				break;
+			}
+
+			/* Offscreen, the capture texture is the only render target */
+			if (!offscreen_){
+				ogre_window_->update(false);
+
+				ogre_window_->swapBuffers();
+			}
+			if (capture_.IsActive()){
+				AllocationScope scope(AllocCapture);
+				capture_.Capture();
+			}
+			RecordLatency();
 
             ogre_root_->renderOneFrame();
 
             Ogre::WindowEventUtilities::messagePump();
+
+			frames++;
+			if ((max_frames_ > 0) && (frames >= max_frames_)){
+				break;
+			}
         }
+#if defined(_WIN32)
+		timeEndPeriod(1);
+#endif
+		capture_.Finish();
+		input_thread_.Stop();
+
+		SaveMicrocodeCache();
     }
     catch (Ogre::Exception &e){
         throw(OgreAppException(std::string("Ogre::Exception: ") + std::string(e.what())));
@@ -569,25 +1084,93 @@ void OgreApplication::MainLoop(void){
     }
 }
 
+void OgreApplication::WaitForNextFrame(void){
+
+	Ogre::Timer* timer = ogre_root_->getTimer();
+	unsigned long long period = (unsigned long long) (1000000.0f / max_fps_);
+	unsigned long long now = timer->getMicroseconds();
+
+	/* After a long frame, start counting again instead of rushing to catch up */
+	if (now > next_frame_time_ + period){
+		next_frame_time_ = now;
+	}
+
+	/* Sleeping is cheap but imprecise, so the last stretch is spent spinning */
+	while (now + frame_spin_time_g < next_frame_time_){
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		now = timer->getMicroseconds();
+	}
+	while (now < next_frame_time_){
+		now = timer->getMicroseconds();
+	}
+
+	next_frame_time_ += period;
+}
+
+
+void OgreApplication::RecordLatency(void){
+
+	/* Time from the input sample that moved the camera to the frame being presented */
+	unsigned long long now = ogre_root_->getTimer()->getMicroseconds();
+	unsigned long long latency = now - input_sample_time_;
+	latency_sum_ += latency;
+	if (latency > latency_max_){
+		latency_max_ = latency;
+	}
+	latency_frames_++;
+}
+
+
+void OgreApplication::ReportFrameStatistics(void){
+
+	unsigned long long now = ogre_root_->getTimer()->getMicroseconds();
+	if ((latency_frames_ == 0) || (now - latency_period_start_ < latency_report_period_g)){
+		return;
+	}
+
+	std::ostringstream report;
+	report << "Input to present latency: average " << (latency_sum_ / latency_frames_) / 1000.0 << " ms, max "
+		<< latency_max_ / 1000.0 << " ms, " << latency_frames_ * 1000000.0 / (now - latency_period_start_) << " fps";
+	Ogre::LogManager::getSingleton().logMessage(report.str());
+	latency_sum_ = 0;
+	latency_max_ = 0;
+	latency_frames_ = 0;
+	latency_period_start_ = now;
+
+	/* Heap use of each subsystem: allocations in the last frame and memory held */
+	std::ostringstream frame_report, live_report;
+	frame_report << "Heap allocations in the last frame:";
+	live_report << "Heap in use:";
+	for (int tag = 0; tag < NUM_ALLOCATION_TAGS; tag++){
+		AllocationStats stats = GetAllocationStats((AllocationTag) tag);
+		const char* name = GetAllocationTagName((AllocationTag) tag);
+		frame_report << " " << name << " " << stats.frame_allocations << " (" << stats.frame_bytes << " bytes)";
+		live_report << " " << name << " " << stats.live_bytes / 1024 << " KB in " << stats.live_blocks << " blocks";
+	}
+	frame_report << ", " << GetFlaggedAllocations() << " flagged since startup";
+	live_report << ", frame arena peak " << frame_arena_.GetPeak() / 1024 << " KB";
+	Ogre::LogManager::getSingleton().logMessage(frame_report.str());
+	Ogre::LogManager::getSingleton().logMessage(live_report.str());
+}
+
+
 void OgreApplication::windowResized(Ogre::RenderWindow* rw){
 
 	/* Update the window and aspect ratio when the window is resized */
 	int width = rw->getWidth(); 
     int height = rw->getHeight();
       
-    Ogre::SceneManager* scene_manager = ogre_root_->getSceneManager("MySceneManager");
-    Ogre::Camera* camera = scene_manager->getCamera("MyCamera");
-
-	if (camera != NULL){
-		camera->setAspectRatio((double)width/height);
-    }
-
-	const OIS::MouseState &ms = mouse_->getMouseState();
-    ms.width = width;
-    ms.height = height;
+	/* The mouse belongs to the input thread */
+	input_thread_.SetMouseArea(width, height);
 
 	ogre_window_->resize(width, height);
 	ogre_window_->windowMovedOrResized();
+
+	/* Every view keeps the shape of its viewport */
+	for (unsigned short v = 0; v < ogre_window_->getNumViewports(); v++){
+		Ogre::Viewport* viewport = ogre_window_->getViewport(v);
+		viewport->getCamera()->setAspectRatio(float(viewport->getActualWidth()) / float(viewport->getActualHeight()));
+	}
 	ogre_window_->update();
 }
 
@@ -595,6 +1178,16 @@ void OgreApplication::windowResized(Ogre::RenderWindow* rw){
 void OgreApplication::CreateAsteroidField(int num_asteroids){
 
 	try {
+		AllocationScope scope(AllocField);
+
+		/* A snapshot is used in place: the simulation works on the mapped records */
+		bool loaded = !field_filename_.empty() && field_snapshot_.Map(field_filename_, sizeof(Asteroid));
+		if (loaded){
+			num_asteroids = field_snapshot_.GetNumRecords();
+			field_seed_ = field_snapshot_.GetSeed();
+			asteroid_ = (Asteroid*) field_snapshot_.GetRecords();
+		}
+
 		/* Check number of asteroids requested */
 		if (num_asteroids > MAX_NUM_ASTEROIDS){
 			num_asteroids_ = MAX_NUM_ASTEROIDS;
@@ -602,34 +1195,47 @@ void OgreApplication::CreateAsteroidField(int num_asteroids){
 			num_asteroids_ = num_asteroids;
 		}
 
-		/* Create asteroid field */
+		/* Scene state and handles of the asteroids; the field itself is generated below unless it was loaded */
+		cube_.assign(num_asteroids_, NULL);
+		cube_in_scene_.assign(num_asteroids_, false);
+		asteroid_index_.resize(num_asteroids_);
+		asteroid_handle_.resize(num_asteroids_);
 		for (int i = 0; i < num_asteroids_; i++){
-            asteroid_[i].pos = Ogre::Vector3(-300 + 600 * (rand() % 1000) / 1000.0f, -300 + 600 * (rand() % 1000) / 1000.0f, 600 * (rand() % 1000) / 1000.0f);
-			asteroid_[i].ori = Ogre::Quaternion(1.0f, 3.14*(rand() % 1000) / 1000.0f, 3.14*(rand() % 1000) / 1000.0f, 3.14*(rand() % 1000) / 1000.0f);
-			asteroid_[i].lm = Ogre::Quaternion(1.0f, 0.005*3.14*(rand() % 1000) / 1000.0f, 0.005*3.14*(rand() % 1000) / 1000.0f, 0.005*3.14*(rand() % 1000) / 1000.0f);
-			asteroid_[i].drift = Ogre::Vector3(((double) rand() / RAND_MAX)*0.2, ((double) rand() / RAND_MAX)*0.2, ((double) rand() / RAND_MAX)*0.2);
-        }
+			asteroid_index_[i] = i;
+			asteroid_handle_[i] = i;
+		}
+		if (loaded){
+			std::ostringstream report;
+			report << "Loaded " << num_asteroids_ << " asteroids from " << field_filename_;
+			Ogre::LogManager::getSingleton().logMessage(report.str());
+		} else {
+			asteroid_storage_.resize(num_asteroids_);
+			asteroid_ = asteroid_storage_.empty() ? NULL : &asteroid_storage_[0];
+			GenerateAsteroids(asteroid_, num_asteroids_, field_seed_);
+			if (!field_filename_.empty()){
+				SaveAsteroidField();
+			}
+		}
 
-		/* Create multiple entities for the asteroids */
+		/* Random creation order scatters neighbours over the arrays */
+		if (morton_sort_period_ > 0.0f){
+			SortAsteroids();
+		}
+
+		/* The compact copy is made from the final order */
+		if (compact_state_){
+			compact_field_.Encode(asteroid_, num_asteroids_);
+			spin_steps_ = 0;
+		}
+		asteroid_grid_.Build(asteroid_, num_asteroids_, grid_cell_size_g);
+
+		/* Entities for the asteroids are created by TransformAsteroidField() as they come into view */
 
         /* Retrieve scene manager and root scene node */
         Ogre::SceneManager* scene_manager = ogre_root_->getSceneManager("MySceneManager");
         Ogre::SceneNode* root_scene_node = scene_manager->getRootSceneNode();
 		Ogre::Camera* camera = scene_manager->getCamera("MyCamera");
 
-        /* Create multiple entities of a mesh */
-		Ogre::String entity_name, prefix("Asteroid");
-		for (int i = 0; i < num_asteroids_; i++){
-			/* Create entity */
-			entity_name = prefix + Ogre::StringConverter::toString(i);
-			//Ogre::Entity *entity = scene_manager->createEntity(entity_name, "Cube");
-			Ogre::Entity *entity = scene_manager->createEntity(entity_name, "Icosahedron");
-
-			/* Create a scene node for the entity */
-			/* The scene node keeps track of the entity's position */
-			cube_[i] = root_scene_node->createChildSceneNode(entity_name);
-			cube_[i]->attachObject(entity);
-		}
 		Ogre::Entity *entity = scene_manager->createEntity("MoveCube","Cube");
 		cube_laser_ = root_scene_node->createChildSceneNode("CubeNode");
 		cube_laser_->attachObject(entity);
@@ -642,6 +1248,7 @@ void OgreApplication::CreateAsteroidField(int num_asteroids){
 		cube_target_->scale(0.2,0.2,0.2);
 
 		laserFire(camera->getOrientation(), camera->getPosition());
+		MarkStartupStage("field creation");
 
     }
     catch (Ogre::Exception &e){
@@ -652,30 +1259,83 @@ void OgreApplication::CreateAsteroidField(int num_asteroids){
     }
 }
 
-bool OgreApplication::frameRenderingQueued(const Ogre::FrameEvent& fe){
-  
-	/* This event is called after a frame is queued for rendering */
-	/* Do stuff in this event since the GPU is rendering and the CPU is idle */
+bool OgreApplication::ProcessInput(void){
 
-	/* Keep animating if flag is on */
-	if (animating_){
-		/* Animate transformation */
-		TransformAsteroidField();
+	/* Run the fixed steps that are due; a long stall is not caught up on, but the
+	   input events it held are still applied at the next step */
+	unsigned long long now = InputThread::Now();
+	if (now > step_time_ + max_steps_per_frame_g*simulation_step_g){
+		step_time_ = now - max_steps_per_frame_g*simulation_step_g;
+	}
+	bool running = true;
+	while (running && (step_time_ + simulation_step_g <= now)){
+		step_time_ += simulation_step_g;
+		running = RunInputStep(step_time_);
 	}
 
-	/* Capture input */
-	keyboard_->capture();
-	mouse_->capture();
+	/* The newest input that reached the camera is that of the last step */
+	input_sample_time_ = ogre_root_->getTimer()->getMicroseconds() - (now - step_time_);
+	return running;
+}
 
-	/* Handle specific key events */
-	if (keyboard_->isKeyDown(OIS::KC_SPACE)){
-		space_down_ = true;
+
+bool OgreApplication::RunInputStep(unsigned long long step_end){
+
+	/* Apply the input events of the step, measuring how long each action was held
+	   within it and counting its presses */
+	unsigned long long step_start = step_end - simulation_step_g;
+	unsigned long long held_time[NUM_ACTIONS];
+	int presses[NUM_ACTIONS];
+	for (int a = 0; a < NUM_ACTIONS; a++){
+		held_time[a] = 0;
+		presses[a] = 0;
+	}
+	InputQueue& queue = input_thread_.GetQueue();
+	const InputEvent* event;
+	while (((event = queue.Front()) != NULL) && (event->time <= step_end)){
+		int a = action_table_.GetAction(event->key);
+		unsigned long long time = std::max(event->time, step_start);
+		if ((a != NO_ACTION) && event->pressed){
+			/* Several keys can share an action; it is held while any of them is */
+			if (action_keys_down_[a]++ == 0){
+				action_down_time_[a] = time;
+				presses[a]++;
+			}
+		} else if ((a != NO_ACTION) && (action_keys_down_[a] > 0)){
+			if (--action_keys_down_[a] == 0){
+				held_time[a] += time - std::max(action_down_time_[a], step_start);
+			}
+		}
+		queue.Pop();
+	}
+	/* A stall that ProcessInput() skipped ends before the step starts, so time held
+	   through it is not counted and a step never holds an action for more than all of it */
+	float held[NUM_ACTIONS]; // Fraction of the step
+	for (int a = 0; a < NUM_ACTIONS; a++){
+		if (action_keys_down_[a] > 0){
+			held_time[a] += step_end - std::max(action_down_time_[a], step_start);
+			action_down_time_[a] = step_end;
+		}
+		held[a] = (float) held_time[a] / simulation_step_g;
 	}
-	if ((!keyboard_->isKeyDown(OIS::KC_SPACE)) && space_down_){
+
+	/* Handle specific key events */
+	if (presses[ActionPause] % 2){
 		animating_ = !animating_;
-		space_down_ = false;
 	}
-	if (keyboard_->isKeyDown(OIS::KC_ESCAPE)){
+	if (presses[ActionToggleHud] % 2){
+		perf_hud_.Toggle();
+	}
+	if (presses[ActionSaveField] > 0){
+		save_requested_ = true;
+	}
+	if (presses[ActionQuit] > 0){
+		/* Buffers and textures we hold must go before the render system does */
+		input_thread_.Stop();
+		capture_.Finish();
+		perf_hud_.Destroy();
+		particles_.Destroy();
+		light_clusters_.Destroy();
         ogre_root_->shutdown();
         ogre_window_->destroy();
         return false;
@@ -693,117 +1353,415 @@ bool OgreApplication::frameRenderingQueued(const Ogre::FrameEvent& fe){
 	}
 	
 	/* Move ship according to keyboard input and last move */
-	/* Movement factors to apply to the ship */
-	double trans_factor = 5.0; // Small continuous translation
-	double small_trans_factor = 1.0; // Translation applied with thrusters
+	/* Movement factors to apply to the ship, per step; held actions apply them in
+	   proportion to the part of the step they were held for */
 	Ogre::Radian rot_factor(Ogre::Math::PI / 180); // Camera rotation with directional thrusters
+	float thrust_factor = 0.1f; // Change of speed with thrusters
 	/*make camera */
-	camera->setPosition(camera->getPosition() + dirction);
+	unsigned long collision_start = ogre_root_->getTimer()->getMicroseconds();
+	MoveShip(camera);
+	collision_time_ += ogre_root_->getTimer()->getMicroseconds() - collision_start;
 
 	/* Apply user commands */
 	/* Camera rotation (thruster) */
-	if (keyboard_->isKeyDown(OIS::KC_UP)){
-		camera->pitch(rot_factor);
-	}
-	
-	if (keyboard_->isKeyDown(OIS::KC_DOWN)){
-		camera->pitch(-rot_factor);
-	}
-
-	if (keyboard_->isKeyDown(OIS::KC_LEFT)){
-		camera->yaw(rot_factor);
-	}
-
-	if (keyboard_->isKeyDown(OIS::KC_RIGHT)){
-		camera->yaw(-rot_factor);
-	}
-
-	if (keyboard_->isKeyDown(OIS::KC_S)){
-		camera->roll(-rot_factor);
-	}
-
-	if (keyboard_->isKeyDown(OIS::KC_X)){
-		camera->roll(rot_factor);
-	}
+	camera->pitch(rot_factor * (held[ActionPitchUp] - held[ActionPitchDown]));
+	camera->yaw(rot_factor * (held[ActionYawLeft] - held[ActionYawRight]));
+	camera->roll(rot_factor * (held[ActionRollRight] - held[ActionRollLeft]));
 
 	/* Camera translation */
-	if (keyboard_->isKeyDown(OIS::KC_A)){
-		dirction += camera->getDirection() * 0.1;
-	}
-
-	if (keyboard_->isKeyDown(OIS::KC_Z)){
-		dirction -= camera->getDirection() * 0.1;
-	}
-
-	if (keyboard_->isKeyDown(OIS::KC_PGUP)){
-        dirction += camera->getUp() * 0.1;
-	}
-	
-	if (keyboard_->isKeyDown(OIS::KC_PGDOWN)){
-        dirction -= camera->getUp() * 0.1;
-	}
- 
-	if (keyboard_->isKeyDown(OIS::KC_COMMA)){
-        dirction += camera->getRight() * 0.1;
-	}
-	
-	if (keyboard_->isKeyDown(OIS::KC_PERIOD)){
-		dirction -= camera->getRight() * 0.1;
-	}
+	dirction += camera->getDirection() * (thrust_factor * (held[ActionThrustForward] - held[ActionThrustBackward]));
+	dirction += camera->getUp() * (thrust_factor * (held[ActionThrustUp] - held[ActionThrustDown]));
+	dirction += camera->getRight() * (thrust_factor * (held[ActionThrustLeft] - held[ActionThrustRight]));
 
 	laserFire(camera->getOrientation(), camera->getPosition());
 	
-	//laser fire button
-	if (keyboard_->isKeyDown(OIS::KC_V)){
+	//laser fire button; a tap fires for one step
+	if ((held[ActionFire] > 0.0f) || (presses[ActionFire] > 0)){
+		unsigned long collision_start = ogre_root_->getTimer()->getMicroseconds();
 		collision();
+		collision_time_ += ogre_root_->getTimer()->getMicroseconds() - collision_start;
 		cube_laser_->setVisible(true);
 		cube_target_->setVisible(false);
+
+		/* The beam lights up its surroundings for as long as it is fired */
+		Ogre::Vector3 beam_start = camera->getPosition() - camera->getUp();
+		for (int i = 0; i < num_laser_lights_g; i++){
+			Ogre::Vector3 light_pos = beam_start + camera->getDirection()*(100.0f*(i + 0.5f) / num_laser_lights_g);
+			light_clusters_.AddLight(light_pos, laser_light_colour_g, laser_light_radius_g, 1.0f, 0.0f);
+		}
 	}else{
 		cube_laser_->setVisible(false);
 		cube_target_->setVisible(true);
 	}
-	//move cube (targeting cube )
-	//if (keyboard_->isKeyDown(OIS::KC_I)){
-	//	dirction += camera->getOrientation() * 0.1;
-	//}
-	//if (keyboard_->isKeyDown(OIS::KC_K)){
-	//	moveCube(0.0, -0.05, 0.0);//down
-	//}
-	//if (keyboard_->isKeyDown(OIS::KC_J)){
-	//	moveCube(-0.05, 0.0, 0.0);//left
-	//}
-	//if (keyboard_->isKeyDown(OIS::KC_L)){
-	//	dirction -= camera->getRight() * 0.1;
-	//}
 
 	/* Reset spaceship position */
-	if (keyboard_->isKeyDown(OIS::KC_R)){
+	if ((held[ActionReset] > 0.0f) || (presses[ActionReset] > 0)){
 		camera->setPosition(0.0, 0.0, 800.0);
 		camera->setOrientation(Ogre::Quaternion::IDENTITY);
 		dirction = Ogre::Vector3(0,0,0);
 	}
+
+    return true;
+}
+
+bool OgreApplication::frameRenderingQueued(const Ogre::FrameEvent& fe){
+  
+	/* This event is called after a frame is queued for rendering */
+	/* Do stuff in this event since the GPU is rendering and the CPU is idle */
+
+	/* Unless input is sampled late by MainLoop, it is handled here and seen in the next frame */
+	if (!late_input_sampling_ && !ProcessInput()){
+		return false;
+	}
+
+	/* Transient data of the last frame is no longer used */
+	frame_arena_.Reset();
+
+	/* The cameras move with the input even when the animation is paused, so the rear
+	   camera follows and the views are bounded again every frame */
+	UpdateViews();
+
+	/* Camera demo */
+	unsigned long simulation_start = ogre_root_->getTimer()->getMicroseconds();
+	if (animating_){
+		Ogre::SceneManager* scene_manager = ogre_root_->getSceneManager("MySceneManager");
+		Ogre::Camera* camera = scene_manager->getCamera("MyCamera");
+
+		/* Restore the spatial order now and then */
+		morton_sort_timer_ += fe.timeSinceLastFrame;
+		if ((morton_sort_period_ > 0.0f) && (morton_sort_timer_ >= morton_sort_period_)){
+			SortAsteroids();
+		}
+
+		/* Animate transformation; done after moving the camera, so that the asteroids
+		   given scene objects are the ones in view of the next frame */
+		TransformAsteroidField();
+
+		/* Rebuild the light lists for the new camera position */
+		{
+			AllocationScope scope(AllocLights);
+			light_clusters_.Update(camera, fe.timeSinceLastFrame);
+		}
+
+		/* Move the particles and stream them to the GPU */
+		{
+			AllocationScope scope(AllocParticles);
+			particles_.Update(camera, fe.timeSinceLastFrame);
+		}
+	}
+	unsigned long simulation_time = ogre_root_->getTimer()->getMicroseconds() - simulation_start;
+
+	/* Statistics of the frame before are the latest complete ones */
+	AllocationScope scope(AllocHud);
+	perf_hud_.Update(fe.timeSinceLastFrame, simulation_time*1.0e-6f, collision_time_*1.0e-6f,
+		ogre_window_->getStatistics(), num_visible_asteroids_, num_asteroids_);
+	collision_time_ = 0;
  
     return true;
 }
 
 void OgreApplication::TransformAsteroidField(void){
 	//create move cube
+	AllocationScope scope(AllocCulling);
 	Ogre::SceneManager* scene_manager = ogre_root_->getSceneManager("MySceneManager");
+	Ogre::SceneNode* root_scene_node = scene_manager->getRootSceneNode();
+	Ogre::Camera* camera = scene_manager->getCamera("MyCamera");
+
+	int materialise_budget = max_materialise_per_frame_g;
+	num_visible_asteroids_ = 0;
+
+	/* With several views the field is tested once against the cones of all of them,
+	   and the node of an asteroid is updated once, however many views draw it; the
+	   views are bounded by UpdateViews() when the cameras move */
+	bool multi_view = (view_culler_.GetNumViews() > 1);
+
+	/* The compact field is culled four asteroids at a time and its orientations are
+	   a function of the frame, so there is nothing to integrate */
+	bool compact = (compact_field_.GetCount() > 0);
+	const unsigned char* compact_visible = NULL;
+	if (compact){
+		if (!multi_view){
+			compact_field_.Cull(camera, asteroid_radius_g);
+			compact_visible = compact_field_.GetVisible();
+		}
+		spin_steps_++;
+	}
 	
+	/* Asteroids that pass culling, and the views that may see them; only needed for this update */
+	int* visible_list = frame_arena_.AllocateArray<int>(num_asteroids_);
+	unsigned int* view_mask = multi_view ? frame_arena_.AllocateArray<unsigned int>(num_asteroids_) : NULL;
+	int num_in_view = 0;
+
 	// Rotate asteroids
     for (int i = 0; i < num_asteroids_; i++){
-		// Set orientation
-		asteroid_[i].ori = asteroid_[i].lm * asteroid_[i].ori;
-		cube_[i]->setOrientation(asteroid_[i].ori);
+		bool visible;
+		unsigned int views = 0;
+		if (compact){
+			if (!multi_view){
+				visible = (compact_visible[i] != 0);
+			} else {
+				if (compact_field_.IsAlive(i)){
+					views = view_culler_.Test(compact_field_.GetPosition(i), asteroid_radius_g);
+				}
+				visible = (views != 0);
+			}
+		} else {
+			if (!asteroid_[i].alive){
+				continue;
+			}
+
+			// Set orientation
+			SpinAsteroid(asteroid_[i]);
 		
-		// Could add some drift as well
-		//asteroid_[i].pos += asteroid_[i].drift;
+			// Could add some drift as well
+			//asteroid_[i].pos += asteroid_[i].drift;
+
+			if (!multi_view){
+				visible = IsAsteroidInView(asteroid_[i], camera);
+			} else {
+				views = view_culler_.Test(asteroid_[i].pos, asteroid_radius_g);
+				visible = (views != 0);
+			}
+		}
+
+		/* Asteroids out of view leave the scene graph */
+		if (!visible){
+			if (cube_in_scene_[i]){
+				root_scene_node->removeChild(cube_[i]);
+				cube_in_scene_[i] = false;
+			}
+			continue;
+		}
+		if (multi_view){
+			view_mask[num_in_view] = views;
+		}
+		visible_list[num_in_view++] = i;
+	}
+
+	if (occlusion_culling_){
+		num_in_view = OccludeAsteroids(camera, visible_list, view_mask, num_in_view);
+	}
+
+	for (int k = 0; k < num_in_view; k++){
+		int i = visible_list[k];
+
+		/* Create the scene objects the first time the asteroid is seen; the budget spreads
+		   the work over several frames when a large part of the field comes into view.
+		   OGRE allocates the objects and their generated names, and an entry of the
+		   child map of the root node when a node is attached; that is allowed in the
+		   steady state, and bounded by the asteroids coming into view */
+		if (cube_[i] == NULL){
+			if (materialise_budget == 0){
+				continue;
+			}
+			materialise_budget--;
+			AllowAllocationScope materialise;
+			MaterialiseAsteroid(i);
+		} else if (!cube_in_scene_[i]){
+			AllowAllocationScope attach;
+			root_scene_node->addChild(cube_[i]);
+			cube_in_scene_[i] = true;
+		}
+		num_visible_asteroids_++;
+
+		if (compact){
+			cube_[i]->setOrientation(compact_field_.GetOrientation(i, spin_steps_));
+			cube_[i]->setPosition(compact_field_.GetPosition(i));
+			continue;
+		}
+
+		cube_[i]->setOrientation(asteroid_[i].ori);
 
 		// Set the position every time
 		cube_[i]->setPosition(asteroid_[i].pos);
     }
 }
 
+
+/* An asteroid that may be drawn into the occlusion buffer */
+struct OccluderCandidate {
+	float distance; // Squared distance to the camera
+	int index;
+	bool operator<(const OccluderCandidate& other) const { return distance < other.distance; }
+};
+
+
+void OgreApplication::UpdateViews(void){
+
+	Ogre::SceneManager* scene_manager = ogre_root_->getSceneManager("MySceneManager");
+	Ogre::Camera* camera = scene_manager->getCamera("MyCamera");
+
+	/* The rear camera sits with the pilot and looks the other way */
+	if (extra_views_ & ViewRear){
+		Ogre::Camera* rear = scene_manager->getCamera("RearCamera");
+		rear->setPosition(camera->getDerivedPosition());
+		rear->setOrientation(camera->getDerivedOrientation()*Ogre::Quaternion(Ogre::Degree(180.0), Ogre::Vector3::UNIT_Y));
+	}
+
+	view_culler_.Update();
+}
+
+
+int OgreApplication::OccludeAsteroids(Ogre::Camera* camera, int* visible_list, unsigned int* view_mask, int num_in_view){
+
+	Ogre::SceneNode* root_scene_node = ogre_root_->getSceneManager("MySceneManager")->getRootSceneNode();
+	bool compact = (compact_field_.GetCount() > 0);
+
+	/* The depth buffer is seen from the pilot camera, the first view; with several
+	   views only what the pilot alone may see can be hidden by it */
+	const unsigned int pilot_view = 1;
+
+	/* The nearest asteroids in view are the occluders; only those with scene objects
+	   are taken, as the others may not be drawn this frame */
+	Ogre::Vector3 eye = camera->getDerivedPosition();
+	OccluderCandidate* candidate = frame_arena_.AllocateArray<OccluderCandidate>(num_in_view);
+	size_t num_candidates = 0;
+	for (int k = 0; k < num_in_view; k++){
+		int i = visible_list[k];
+		if ((cube_[i] != NULL) && ((view_mask == NULL) || (view_mask[k] & pilot_view))){
+			Ogre::Vector3 pos = compact ? compact_field_.GetPosition(i) : asteroid_[i].pos;
+			candidate[num_candidates].distance = pos.squaredDistance(eye);
+			candidate[num_candidates].index = i;
+			num_candidates++;
+		}
+	}
+	size_t num_occluders = num_candidates;
+	if (num_occluders > max_occluders_g){
+		num_occluders = max_occluders_g;
+		std::nth_element(candidate, candidate + num_occluders, candidate + num_candidates);
+	}
+
+	occlusion_culler_.Begin(camera);
+	for (size_t k = 0; k < num_occluders; k++){
+		int i = candidate[k].index;
+		Ogre::Vector3 pos = compact ? compact_field_.GetPosition(i) : asteroid_[i].pos;
+		occlusion_culler_.DrawOccluder(pos, asteroid_inner_radius_g);
+	}
+	occlusion_culler_.BuildHierarchy();
+
+	/* Hidden asteroids leave the scene graph like those out of view; the masks are
+	   moved with the indices so that they stay paired */
+	int num_kept = 0;
+	for (int k = 0; k < num_in_view; k++){
+		int i = visible_list[k];
+		Ogre::Vector3 pos = compact ? compact_field_.GetPosition(i) : asteroid_[i].pos;
+		bool pilot_only = (view_mask == NULL) || (view_mask[k] == pilot_view);
+		if (pilot_only && occlusion_culler_.IsOccluded(pos, asteroid_radius_g)){
+			if (cube_in_scene_[i]){
+				root_scene_node->removeChild(cube_[i]);
+				cube_in_scene_[i] = false;
+			}
+			continue;
+		}
+		if (view_mask != NULL){
+			view_mask[num_kept] = view_mask[k];
+		}
+		visible_list[num_kept++] = i;
+	}
+	return num_kept;
+}
+
+
+void OgreApplication::MaterialiseAsteroid(int i){
+
+	/* Objects are anonymous: they are only ever reached through cube_ */
+	Ogre::SceneManager* scene_manager = ogre_root_->getSceneManager("MySceneManager");
+	Ogre::Entity *entity = scene_manager->createEntity("Icosahedron");
+	cube_[i] = scene_manager->getRootSceneNode()->createChildSceneNode();
+	cube_[i]->attachObject(entity);
+	cube_in_scene_[i] = true;
+}
+
+void OgreApplication::SaveAsteroidField(void){
+
+	if (field_filename_.empty()){
+		return;
+	}
+	AllocationScope scope(AllocField);
+	SyncCompactField();
+
+	/* The snapshot being replaced may be the one the field is mapped from, so the
+	   field first moves to memory of its own */
+	if (field_snapshot_.GetRecords() != NULL){
+		asteroid_storage_.assign(asteroid_, asteroid_ + num_asteroids_);
+		asteroid_ = asteroid_storage_.empty() ? NULL : &asteroid_storage_[0];
+		field_snapshot_.Unmap();
+	}
+	field_snapshot_.Save(field_filename_, asteroid_, sizeof(Asteroid), num_asteroids_, field_seed_);
+}
+
+
+void OgreApplication::SyncCompactField(void){
+
+	/* Orientations of the compact field become those of the records */
+	if (compact_field_.GetCount() > 0){
+		compact_field_.DecodeOrientations(asteroid_, spin_steps_);
+	}
+}
+
+
+void OgreApplication::SortAsteroids(void){
+
+	AllocationScope scope(AllocField);
+	morton_sort_timer_ = 0.0f;
+	if (num_asteroids_ < 2){
+		return;
+	}
+	SyncCompactField();
+
+	/* Codes are relative to the bounding box of the field */
+	Ogre::Vector3 min = asteroid_[0].pos;
+	Ogre::Vector3 max = asteroid_[0].pos;
+	for (int i = 1; i < num_asteroids_; i++){
+		min.makeFloor(asteroid_[i].pos);
+		max.makeCeil(asteroid_[i].pos);
+	}
+	morton_code_.resize(num_asteroids_);
+	for (int i = 0; i < num_asteroids_; i++){
+		morton_code_[i] = MortonCode(asteroid_[i].pos, min, max - min);
+	}
+	SortByMortonCode(morton_code_, sort_order_, sort_scratch_);
+
+	/* Apply the permutation in place, one cycle at a time; an entry of sort_order_
+	   is set to its own position once it has been moved */
+	for (int start = 0; start < num_asteroids_; start++){
+		if (sort_order_[start] == start){
+			continue;
+		}
+		Asteroid asteroid = asteroid_[start];
+		Ogre::SceneNode* cube = cube_[start];
+		bool in_scene = cube_in_scene_[start];
+		int handle = asteroid_handle_[start];
+		int k = start;
+		while (sort_order_[k] != start){
+			int source = sort_order_[k];
+			asteroid_[k] = asteroid_[source];
+			cube_[k] = cube_[source];
+			cube_in_scene_[k] = cube_in_scene_[source];
+			asteroid_handle_[k] = asteroid_handle_[source];
+			sort_order_[k] = k;
+			k = source;
+		}
+		asteroid_[k] = asteroid;
+		cube_[k] = cube;
+		cube_in_scene_[k] = in_scene;
+		asteroid_handle_[k] = handle;
+		sort_order_[k] = k;
+	}
+
+	for (int i = 0; i < num_asteroids_; i++){
+		asteroid_index_[asteroid_handle_[i]] = i;
+	}
+
+	/* The compact copy and the collision grid follow the new order */
+	if (compact_field_.GetCount() > 0){
+		compact_field_.Encode(asteroid_, num_asteroids_);
+		spin_steps_ = 0;
+	}
+	asteroid_grid_.Build(asteroid_, num_asteroids_, grid_cell_size_g);
+}
+
+
 void OgreApplication::laserFire(Ogre::Quaternion value, Ogre::Vector3 pos )
 {
 		Ogre::SceneManager* scene_manager = ogre_root_->getSceneManager("MySceneManager");
@@ -829,6 +1787,9 @@ void OgreApplication::CreateTargetingCube (void){
         Ogre::SceneNode* root_scene_node = scene_manager->getRootSceneNode();
 
 		//create first cylinder which is called A as center
+		if (cube_.empty()){
+			cube_.resize(1, NULL);
+		}
 		Ogre::Entity *entity0 = scene_manager->createEntity("MoveCube", "Cube");
 		cube_[0] = root_scene_node->createChildSceneNode("MoveCube");
 		cube_[0]->attachObject(entity0);
@@ -871,22 +1832,93 @@ void OgreApplication::collision()
 	Ogre::Vector3 l = camera->getDirection();
 	Ogre::Vector3 o = camera->getPosition();
 
-	int r = 1;
-	for(int i=0; i< MAX_NUM_ASTEROIDS; i++)
+	/* Only the asteroids of the field exist; slots past num_asteroids_ hold nothing */
+	for(int i=0; i< num_asteroids_; i++)
 	{
-		Ogre::Vector3 c = asteroid_[i].pos;
-		Ogre::Vector3 dir = c - o;
-		float length = dir.length();
-		float value = l.dotProduct(dir)*l.dotProduct(dir)- length*length + r*r;
-		if(value > 0){
-			Ogre::String entity_name, prefix("Asteroid");
-			entity_name = prefix + Ogre::StringConverter::toString(i);
-			Ogre::SceneNode* root_scene_node = scene_manager->getSceneNode(entity_name);			
-			root_scene_node->detachAllObjects();
+		/* Asteroids that were already hit are gone; hitting them again would spawn
+		   their sparks and light a second time */
+		if (!asteroid_[i].alive){
+			continue;
+		}
+		/* The laser only fires forward: asteroids behind the camera are never hit */
+		if (RayHitsAsteroid(asteroid_[i], o, l)){
+			/* Sparks fly back towards the shooter */
+			DestroyAsteroid(i, -l);
 		}
 	}
 
 }
 
 
+void OgreApplication::DestroyAsteroid(int i, const Ogre::Vector3& spark_direction){
+
+	Ogre::Vector3 c = asteroid_[i].pos;
+	asteroid_[i].alive = false;
+	if (compact_field_.GetCount() > 0){
+		compact_field_.Kill(i);
+	}
+	if (cube_[i] != NULL){
+		cube_[i]->detachAllObjects();
+	}
+
+	/* Flash at the hit, followed by a fading explosion */
+	light_clusters_.AddLight(c, hit_light_colour_g, hit_light_radius_g, 2.0f, hit_light_life_g);
+	light_clusters_.AddLight(c, explosion_light_colour_g, explosion_light_radius_g, 3.0f, explosion_light_life_g);
+
+	/* Sparks fly along spark_direction, debris in all directions */
+	particles_.EmitSparks(c, spark_direction, sparks_per_hit_g);
+	particles_.EmitDebris(c, debris_per_explosion_g);
+}
+
+
+void OgreApplication::MoveShip(Ogre::Camera* camera){
+
+	/* The ship moves by dirction each step. The whole motion is swept against the
+	   field, so the ship cannot skip over an asteroid however fast it goes; after a
+	   contact the rest of the motion is swept again */
+	ship_contacts_.clear();
+	Ogre::Vector3 position = camera->getPosition();
+	Ogre::Vector3 motion = dirction;
+	for (int contacts = 0; contacts <= max_ship_contacts_g; contacts++){
+		ShipContact contact;
+		if ((ship_collision_ == ShipCollisionOff) ||
+			!asteroid_grid_.SweepSphere(asteroid_, position, position + motion, ship_radius_g, asteroid_radius_g, contact)){
+			position += motion;
+			break;
+		}
+
+		/* Too many contacts in one step: stay where the last one left the ship */
+		if (contacts == max_ship_contacts_g){
+			break;
+		}
+		contact.handle = asteroid_handle_[contact.index];
+		ship_contacts_.push_back(contact);
+
+		if (ship_collision_ == ShipCollisionDestroy){
+			/* The asteroid is gone and the ship goes on */
+			DestroyAsteroid(contact.index, contact.normal);
+			continue;
+		}
+
+		/* Scrape at the contact */
+		light_clusters_.AddLight(contact.point, hit_light_colour_g, hit_light_radius_g, 2.0f, hit_light_life_g);
+		particles_.EmitSparks(contact.point, contact.normal, sparks_per_hit_g);
+
+		position += motion*contact.time;
+		if (ship_collision_ == ShipCollisionStop){
+			dirction = Ogre::Vector3::ZERO;
+			break;
+		}
+
+		/* Bounce: the velocity into the asteroid is reflected and damped, for the
+		   ship and for the rest of this step */
+		float bounce = 1.0f + ship_restitution_g;
+		motion = motion*(1.0f - contact.time);
+		motion -= contact.normal*(bounce*std::min(0.0f, motion.dotProduct(contact.normal)));
+		dirction -= contact.normal*(bounce*std::min(0.0f, dirction.dotProduct(contact.normal)));
+	}
+	camera->setPosition(position);
+}
+
+
 } // namespace ogre_application;
\ No newline at end of file
@@ -10,8 +10,28 @@
 #include "OGRE/OgreWindowEventUtilities.h"
 #include "OGRE/OgreManualObject.h"
 #include "OGRE/OgreEntity.h"
+#include "OGRE/OgreTimer.h"
+#include "OGRE/Overlay/OgreOverlaySystem.h"
 #include "OIS/OIS.h"
 
+#include "asteroid.h"
+#include "light_clusters.h"
+#include "resource_loading.h"
+#include "worker_pool.h"
+#include "particle_system.h"
+#include "frame_capture.h"
+#include "perf_hud.h"
+#include "morton_order.h"
+#include "field_snapshot.h"
+#include "compact_field.h"
+#include "occlusion_culler.h"
+#include "asteroid_grid.h"
+#include "allocation_tracking.h"
+#include "frame_arena.h"
+#include "action_table.h"
+#include "input_thread.h"
+#include "view_culler.h"
+
 namespace ogre_application {
 
 
@@ -28,17 +48,30 @@ namespace ogre_application {
 			virtual const char* what() const throw() { return message_.c_str(); };
 	};
 
-	/* An asteroid */
-    struct Asteroid {
-        Ogre::Vector3 pos; // Position
-        Ogre::Quaternion ori; // Orientation
-        Ogre::Quaternion lm; // Angular momentum (use as velocity)
-		Ogre::Vector3 drift; // Drift direction
-    };
-
 	/* Possible directions of the ship */
 	enum Direction { Forward, Backward, Up, Down, Left, Right };
 
+	/* How the main loop paces frames */
+	enum FramePacing {
+		VSync, // Wait for the vertical blank when presenting
+		Uncapped, // Render as fast as possible
+		FrameLimited // Hold frames to a fixed rate, sleeping then spinning until the frame is due
+	};
+
+	/* What happens when the ship runs into an asteroid */
+	enum ShipCollision {
+		ShipCollisionOff, // Fly through asteroids
+		ShipCollisionStop, // Stop at the contact
+		ShipCollisionBounce, // Reflect the velocity into the asteroid
+		ShipCollisionDestroy // Destroy the asteroid and fly on
+	};
+
+	/* Views drawn besides the pilot view, as bits of a mask */
+	enum ExtraView {
+		ViewRear = 1, // Looking back from the ship, in a strip at the top of the window
+		ViewTactical = 2 // The whole field from above, in a corner of the window
+	};
+
 	/* Our Ogre application */
 	class OgreApplication :
 	    public Ogre::FrameListener, // Derive from FrameListener to be able to have render event callbacks
@@ -51,10 +84,28 @@ namespace ogre_application {
 			void CreateCube(void); // Create the geometry for a single cube
 			void CreateIcosahedron(void); // Create the geometry for an icosahedron
 			void MainLoop(void); // Keep application active
+			void SetLoadingProgressCallback(LoadingProgressCallback callback); // Call before Init() to follow resource loading
+			void SetFramePacing(FramePacing pacing, float max_fps); // Call before Init(); max_fps is used by FrameLimited
+			void SetLateInputSampling(bool late); // Sample input right before rendering instead of after
+			void SetInputBindings(const Ogre::String& filename); // Call before Init() to read the controls from a file
+			void SetCapture(const Ogre::String& directory, CaptureFormat format); // Call before Init() to save every frame
+			void SetOffscreen(bool offscreen); // Call before Init(); render only to the capture texture, with the window hidden
+			void SetMaxFrames(int max_frames); // Leave the main loop after this many frames; zero runs until closed
+			void SetViews(unsigned int views); // Call before Init(); a mask of ExtraView values to draw besides the pilot view
 
 			/* Camera demo */
 			void CreateAsteroidField(int num_asteroids); // Create asteroid field
 			void TransformAsteroidField(void);
+			int GetNumVisibleAsteroids(void) const { return num_visible_asteroids_; }
+			void SetFieldSnapshot(const Ogre::String& filename); // Call before CreateAsteroidField(); load the field from this file, or save it there once created
+			void SetFieldSeed(unsigned int seed); // Call before CreateAsteroidField() to generate a different field
+			void SaveAsteroidField(void); // Write the field to the snapshot file in the background
+			void SetCompactState(bool compact); // Call before CreateAsteroidField(); update and cull from quantised state
+			void SetMortonSortPeriod(float seconds); // Call before CreateAsteroidField(); zero keeps creation order
+			void SetOcclusionCulling(bool occlusion); // Hide asteroids behind the nearest ones in view
+			void SetShipCollision(ShipCollision response); // How the ship reacts to running into an asteroid
+			const std::vector<ShipContact>& GetShipContacts(void) const { return ship_contacts_; } // Contacts of the last ship move, in order
+			int GetAsteroidIndex(int handle) const { return asteroid_index_[handle]; } // Handles are creation order and survive sorting
 
 			//
 			//void laserFire(Ogre::Quaternion* value, int i);
@@ -65,28 +116,105 @@ namespace ogre_application {
         private:
 			// Create root that allows us to access Ogre commands
             std::auto_ptr<Ogre::Root> ogre_root_;
+			// Overlay managers; declared after the root so they are destroyed before it
+			std::auto_ptr<Ogre::OverlaySystem> overlay_system_;
             // Main Ogre window
             Ogre::RenderWindow* ogre_window_;
 
 			/* Animation-related variables */
 			bool animating_; // Whether animation is on or off
-			bool space_down_; // Whether space key was pressed
 
 			/* Camera demo variables */
-			#define MAX_NUM_ASTEROIDS 1500 // Number of elements in the chain
+			#define MAX_NUM_ASTEROIDS 4000000 // Largest field that can be created
 			int num_asteroids_;
+			int num_visible_asteroids_; // Asteroids that were in view in the last update
 			int counter;
-			Asteroid asteroid_[MAX_NUM_ASTEROIDS];
-			Ogre::SceneNode* cube_[MAX_NUM_ASTEROIDS];
+			Asteroid* asteroid_; // Points into asteroid_storage_ or into a mapped snapshot
+			std::vector<Asteroid> asteroid_storage_;
+			FieldSnapshot field_snapshot_;
+			Ogre::String field_filename_; // Empty when snapshots are not used
+			unsigned int field_seed_; // Seed of rand() when the field is generated
+			bool save_requested_; // F5 was pressed; the save runs where the frame loop may allocate
+			/* Optional compact copy used by the per-frame update; orientations in asteroid_
+			   are then only brought up to date when the full records are needed */
+			bool compact_state_;
+			CompactField compact_field_;
+			unsigned long spin_steps_; // Frames the compact field has been animated for
+			/* Asteroids in view are further tested against a software depth buffer of the
+			   nearest ones */
+			bool occlusion_culling_;
+			OcclusionCuller occlusion_culler_;
+			/* Collisions of the ship with the field */
+			AsteroidGrid asteroid_grid_; // Rebuilt whenever the asteroids are reordered
+			ShipCollision ship_collision_;
+			std::vector<ShipContact> ship_contacts_;
+			/* With several views, the asteroids any of them may see are found in one pass
+			   and their nodes updated once for all of them */
+			unsigned int extra_views_;
+			ViewCuller view_culler_;
+			/* Scene nodes are only created once an asteroid comes into view; the node of an
+			   asteroid out of view is taken out of the scene graph so OGRE does not visit it */
+			std::vector<Ogre::SceneNode*> cube_; // NULL until the asteroid is first seen
+			std::vector<bool> cube_in_scene_; // Whether the node is attached to the scene graph
+			/* The arrays above can be kept sorted along a Morton curve so that asteroids close
+			   in space are close in memory; handles map to the current indices */
+			std::vector<int> asteroid_index_; // Index of the asteroid with a given handle
+			std::vector<int> asteroid_handle_; // Handle of the asteroid at a given index
+			float morton_sort_period_; // Seconds between sorts
+			float morton_sort_timer_; // Seconds since the last sort
+			std::vector<unsigned int> morton_code_;
+			std::vector<int> sort_order_;
+			std::vector<int> sort_scratch_;
 			Ogre::SceneNode* cube_laser_;
 			Ogre::SceneNode* cube_target_;
 			enum Direction last_dir_;
 			Ogre:: Vector3 dirction;
 			Ogre:: Quaternion q;
+			LightClusters light_clusters_; // Dynamic lights for laser beams, hits and explosions
+			WorkerPool worker_pool_; // Threads that share the per-frame work
+			FrameArena frame_arena_; // Transient data of the current frame, reset when the next one starts
+			ParticleSystem particles_; // Sparks and debris
+			PerfHud perf_hud_; // Frame statistics, toggled with F1
+			unsigned long collision_time_; // Microseconds spent in collision tests since the last frame
 			// Input managers
 			OIS::InputManager *input_manager_;
 			OIS::Mouse *mouse_;
 			OIS::Keyboard *keyboard_;
+			/* Input is sampled on its own thread and applied in fixed simulation steps */
+			InputThread input_thread_;
+			ActionTable action_table_;
+			Ogre::String bindings_filename_; // Empty for the default controls
+			unsigned long long step_time_; // End of the last step, on the clock of the input thread
+			int action_keys_down_[NUM_ACTIONS]; // Keys of each action that are held
+			unsigned long long action_down_time_[NUM_ACTIONS]; // Since when a held action counts for the current step
+
+			/* Startup profiling */
+			Ogre::Timer startup_timer_; // Time since the last startup stage ended
+			std::vector<std::pair<Ogre::String, unsigned long> > startup_stages_; // Stage name and duration in microseconds
+			LoadingProgressCallback loading_progress_callback_;
+
+			/* Frame pacing and latency */
+			FramePacing frame_pacing_;
+			float max_fps_;
+			bool late_input_sampling_; // Whether MainLoop samples input just before rendering
+			unsigned long long next_frame_time_; // When the next frame is due with FrameLimited, in microseconds
+			unsigned long long input_sample_time_; // When input was last captured, in microseconds
+			unsigned long long latency_sum_; // Input to present latency summed over the report period
+			unsigned long long latency_max_;
+			unsigned long long latency_frames_;
+			unsigned long long latency_period_start_;
+			void WaitForNextFrame(void);
+			void RecordLatency(void);
+			void ReportFrameStatistics(void); // Log latency and heap use once per report period
+
+			/* Frame capture */
+			FrameCapture capture_;
+			Ogre::String capture_directory_; // Empty when frames are not captured
+			CaptureFormat capture_format_;
+			bool offscreen_;
+			int max_frames_;
+			void MarkStartupStage(const Ogre::String& stage);
+			void LogStartupTimes(void);
 
 			/* Methods to initialize the application */
 			void InitRootNode(void);
@@ -94,11 +222,27 @@ namespace ogre_application {
 			void InitRenderSystem(void);
 			void InitWindow(void);
 			void InitViewport(void);
+			void InitViews(void);
 			void InitEvents(void);
 			void InitOIS(void);
 			void LoadMaterials(void);
+			void InitLighting(void);
+			void InitParticles(void);
+			void InitCapture(void);
+			void InitPerfHud(void);
+			void MaterialiseAsteroid(int i);
+			void SortAsteroids(void);
+			void SyncCompactField(void);
+			int OccludeAsteroids(Ogre::Camera* camera, int* visible_list, unsigned int* view_mask, int num_in_view); // Returns how many are not occluded, moved to the front with their view masks
+			void UpdateViews(void); // Move the cameras that follow the pilot and bound the views for culling
+			void MoveShip(Ogre::Camera* camera); // Move the camera by dirction, stopping at asteroids
+			void DestroyAsteroid(int i, const Ogre::Vector3& spark_direction);
+			void LoadMicrocodeCache(void);
+			void SaveMicrocodeCache(void);
 
 			/* Methods to handle events */
+			bool ProcessInput(void); // Run the simulation steps that are due; returns false when the application should quit
+			bool RunInputStep(unsigned long long step_end);
 			bool frameRenderingQueued(const Ogre::FrameEvent& fe);
 			void windowResized(Ogre::RenderWindow* rw);
 
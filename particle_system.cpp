@@ -0,0 +1,352 @@
+#include <cstring>
+#include <xmmintrin.h>
+#include <emmintrin.h>
+
+#include "OGRE/OgreHardwareBufferManager.h"
+
+#include "particle_system.h"
+
+namespace ogre_application {
+
+/* Material used to draw the particles */
+const Ogre::String particle_material_name_g = "ParticleMaterial";
+
+/* Number of arrays in the particle pool */
+const int num_particle_arrays_g = 13;
+
+
+ParticleRenderable::ParticleRenderable(void){
+
+	write_pos_ = 0;
+	mRenderOp.vertexData = NULL;
+	mRenderOp.indexData = NULL;
+}
+
+
+ParticleRenderable::~ParticleRenderable(void){
+
+	OGRE_DELETE mRenderOp.vertexData;
+	OGRE_DELETE mRenderOp.indexData;
+}
+
+
+void ParticleRenderable::Init(const Ogre::String& material_name){
+
+	/* Vertex format: position, colour and quad corner */
+	mRenderOp.vertexData = OGRE_NEW Ogre::VertexData();
+	mRenderOp.vertexData->vertexStart = 0;
+	mRenderOp.vertexData->vertexCount = 0;
+	Ogre::VertexDeclaration* declaration = mRenderOp.vertexData->vertexDeclaration;
+	size_t offset = 0;
+	declaration->addElement(0, offset, Ogre::VET_FLOAT3, Ogre::VES_POSITION);
+	offset += Ogre::VertexElement::getTypeSize(Ogre::VET_FLOAT3);
+	declaration->addElement(0, offset, Ogre::VET_COLOUR_ABGR, Ogre::VES_DIFFUSE);
+	offset += Ogre::VertexElement::getTypeSize(Ogre::VET_COLOUR_ABGR);
+	declaration->addElement(0, offset, Ogre::VET_FLOAT2, Ogre::VES_TEXTURE_COORDINATES, 0);
+
+	/* The vertex buffer holds several frames worth of quads */
+	Ogre::HardwareBufferManager& buffer_manager = Ogre::HardwareBufferManager::getSingleton();
+	vertex_buffer_ = buffer_manager.createVertexBuffer(sizeof(ParticleVertex), MAX_NUM_PARTICLES*4*PARTICLE_RING_FRAMES,
+		Ogre::HardwareBuffer::HBU_DYNAMIC_WRITE_ONLY_DISCARDABLE);
+	mRenderOp.vertexData->vertexBufferBinding->setBinding(0, vertex_buffer_);
+
+	/* The indices never change: two triangles per quad, relative to the start of the frame's vertices */
+	mRenderOp.operationType = Ogre::RenderOperation::OT_TRIANGLE_LIST;
+	mRenderOp.useIndexes = true;
+	mRenderOp.indexData = OGRE_NEW Ogre::IndexData();
+	mRenderOp.indexData->indexStart = 0;
+	mRenderOp.indexData->indexCount = 0;
+	mRenderOp.indexData->indexBuffer = buffer_manager.createIndexBuffer(Ogre::HardwareIndexBuffer::IT_16BIT,
+		MAX_NUM_PARTICLES*6, Ogre::HardwareBuffer::HBU_STATIC_WRITE_ONLY);
+	Ogre::uint16* index = static_cast<Ogre::uint16*>(mRenderOp.indexData->indexBuffer->lock(Ogre::HardwareBuffer::HBL_DISCARD));
+	for (int i = 0; i < MAX_NUM_PARTICLES; i++){
+		Ogre::uint16 base = (Ogre::uint16) (i*4);
+		*index++ = base;
+		*index++ = base + 1;
+		*index++ = base + 2;
+		*index++ = base;
+		*index++ = base + 2;
+		*index++ = base + 3;
+	}
+	mRenderOp.indexData->indexBuffer->unlock();
+
+	/* Particles can be anywhere */
+	mBox.setInfinite();
+	setMaterial(material_name);
+	setCastShadows(false);
+}
+
+
+ParticleVertex* ParticleRenderable::Lock(int num_particles){
+
+	size_t num_vertices = num_particles*4;
+	Ogre::HardwareBuffer::LockOptions options = Ogre::HardwareBuffer::HBL_NO_OVERWRITE;
+	if (write_pos_ + num_vertices > vertex_buffer_->getNumVertices()){
+		/* Wrap around; discarding lets the driver hand out fresh memory while the
+		   GPU finishes with the old contents */
+		write_pos_ = 0;
+		options = Ogre::HardwareBuffer::HBL_DISCARD;
+	}
+
+	void* data = vertex_buffer_->lock(write_pos_*sizeof(ParticleVertex), num_vertices*sizeof(ParticleVertex), options);
+	mRenderOp.vertexData->vertexStart = write_pos_;
+	mRenderOp.vertexData->vertexCount = num_vertices;
+	mRenderOp.indexData->indexCount = num_particles*6;
+	write_pos_ += num_vertices;
+
+	return static_cast<ParticleVertex*>(data);
+}
+
+
+void ParticleRenderable::Unlock(void){
+
+	vertex_buffer_->unlock();
+}
+
+
+ParticleSystem::ParticleSystem(void){
+
+	memory_ = NULL;
+	num_particles_ = 0;
+	worker_pool_ = NULL;
+	renderable_ = NULL;
+	node_ = NULL;
+	random_state_ = 2463534242u;
+	elapsed_time_ = 0.0f;
+	vertex_ = NULL;
+}
+
+
+ParticleSystem::~ParticleSystem(void){
+
+	Destroy();
+	_mm_free(memory_);
+}
+
+
+void ParticleSystem::Init(Ogre::SceneManager* scene_manager, WorkerPool* worker_pool){
+
+	worker_pool_ = worker_pool;
+
+	/* One aligned block for the whole pool */
+	memory_ = static_cast<float*>(_mm_malloc(num_particle_arrays_g*MAX_NUM_PARTICLES*sizeof(float), 16));
+	memset(memory_, 0, num_particle_arrays_g*MAX_NUM_PARTICLES*sizeof(float));
+	float** array[num_particle_arrays_g] = {&pos_x_, &pos_y_, &pos_z_, &vel_x_, &vel_y_, &vel_z_,
+		&life_, &inv_max_life_, &drag_, &size_, &red_, &green_, &blue_};
+	for (int i = 0; i < num_particle_arrays_g; i++){
+		*array[i] = memory_ + i*MAX_NUM_PARTICLES;
+	}
+
+	renderable_ = OGRE_NEW ParticleRenderable();
+	renderable_->Init(particle_material_name_g);
+	renderable_->setVisible(false);
+	node_ = scene_manager->getRootSceneNode()->createChildSceneNode();
+	node_->attachObject(renderable_);
+}
+
+
+void ParticleSystem::Destroy(void){
+
+	if (renderable_ == NULL){
+		return;
+	}
+
+	/* Deleting the renderable detaches it from the node */
+	OGRE_DELETE renderable_;
+	renderable_ = NULL;
+	node_->getCreator()->destroySceneNode(node_);
+	node_ = NULL;
+	num_particles_ = 0;
+}
+
+
+float ParticleSystem::Random(void){
+
+	/* Xorshift generator, so that emitting does not disturb rand() */
+	random_state_ ^= random_state_ << 13;
+	random_state_ ^= random_state_ >> 17;
+	random_state_ ^= random_state_ << 5;
+	return (random_state_ & 0xFFFFFF) / float(0x1000000);
+}
+
+
+void ParticleSystem::Emit(const Ogre::Vector3& pos, const Ogre::Vector3& vel, float life, float drag, float size, float red, float green, float blue){
+
+	/* When the pool is full new particles are dropped */
+	if ((renderable_ == NULL) || (num_particles_ >= MAX_NUM_PARTICLES)){
+		return;
+	}
+
+	int i = num_particles_++;
+	pos_x_[i] = pos.x;
+	pos_y_[i] = pos.y;
+	pos_z_[i] = pos.z;
+	vel_x_[i] = vel.x;
+	vel_y_[i] = vel.y;
+	vel_z_[i] = vel.z;
+	life_[i] = life;
+	inv_max_life_[i] = 1.0f / life;
+	drag_[i] = drag;
+	size_[i] = size;
+	red_[i] = red;
+	green_[i] = green;
+	blue_[i] = blue;
+}
+
+
+void ParticleSystem::EmitSparks(const Ogre::Vector3& pos, const Ogre::Vector3& dir, int count){
+
+	for (int i = 0; i < count; i++){
+		Ogre::Vector3 scatter(Random() - 0.5f, Random() - 0.5f, Random() - 0.5f);
+		Ogre::Vector3 vel = dir*(20.0f + 40.0f*Random()) + scatter*30.0f;
+		Emit(pos, vel, 0.3f + 0.3f*Random(), 3.0f, 0.15f, 1.0f, 0.8f, 0.3f);
+	}
+}
+
+
+void ParticleSystem::EmitDebris(const Ogre::Vector3& pos, int count){
+
+	for (int i = 0; i < count; i++){
+		Ogre::Vector3 dir(Random() - 0.5f, Random() - 0.5f, Random() - 0.5f);
+		dir.normalise();
+		Ogre::Vector3 vel = dir*(2.0f + 10.0f*Random());
+		Emit(pos + dir*Random(), vel, 1.5f + 1.5f*Random(), 0.5f, 0.3f + 0.3f*Random(), 1.0f, 0.45f, 0.15f);
+	}
+}
+
+
+void ParticleSystem::Kill(int i){
+
+	/* Move the last particle into the slot */
+	int last = --num_particles_;
+	float* array[num_particle_arrays_g] = {pos_x_, pos_y_, pos_z_, vel_x_, vel_y_, vel_z_,
+		life_, inv_max_life_, drag_, size_, red_, green_, blue_};
+	for (int a = 0; a < num_particle_arrays_g; a++){
+		array[a][i] = array[a][last];
+	}
+}
+
+
+void ParticleSystem::Update(const Ogre::Camera* camera, float elapsed_time){
+
+	if (renderable_ == NULL){
+		return;
+	}
+
+	/* Simulate; the count is rounded up to whole SIMD groups, the slots past the end are unused */
+	elapsed_time_ = elapsed_time;
+	worker_pool_->ParallelFor(SimulateBatch, this, (num_particles_ + 3) & ~3, PARTICLE_BATCH_SIZE);
+
+	/* Remove the dead particles */
+	int i = 0;
+	while (i < num_particles_){
+		if (life_[i] <= 0.0f){
+			Kill(i);
+		} else {
+			i++;
+		}
+	}
+
+	if (num_particles_ == 0){
+		renderable_->setVisible(false);
+		return;
+	}
+
+	/* Build camera facing quads straight into the vertex buffer */
+	right_ = camera->getRight();
+	up_ = camera->getUp();
+	vertex_ = renderable_->Lock(num_particles_);
+	worker_pool_->ParallelFor(WriteVerticesBatch, this, num_particles_, PARTICLE_BATCH_SIZE);
+	renderable_->Unlock();
+	renderable_->setVisible(true);
+}
+
+
+void ParticleSystem::SimulateBatch(void* context, int begin, int end){
+
+	ParticleSystem* system = static_cast<ParticleSystem*>(context);
+	const __m128 dt = _mm_set1_ps(system->elapsed_time_);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+
+	for (int i = begin; i < end; i += 4){
+		/* Drag slows the particle down, then it moves along its velocity */
+		__m128 damping = _mm_max_ps(zero, _mm_sub_ps(one, _mm_mul_ps(_mm_load_ps(system->drag_ + i), dt)));
+		__m128 vx = _mm_mul_ps(_mm_load_ps(system->vel_x_ + i), damping);
+		__m128 vy = _mm_mul_ps(_mm_load_ps(system->vel_y_ + i), damping);
+		__m128 vz = _mm_mul_ps(_mm_load_ps(system->vel_z_ + i), damping);
+		_mm_store_ps(system->vel_x_ + i, vx);
+		_mm_store_ps(system->vel_y_ + i, vy);
+		_mm_store_ps(system->vel_z_ + i, vz);
+		_mm_store_ps(system->pos_x_ + i, _mm_add_ps(_mm_load_ps(system->pos_x_ + i), _mm_mul_ps(vx, dt)));
+		_mm_store_ps(system->pos_y_ + i, _mm_add_ps(_mm_load_ps(system->pos_y_ + i), _mm_mul_ps(vy, dt)));
+		_mm_store_ps(system->pos_z_ + i, _mm_add_ps(_mm_load_ps(system->pos_z_ + i), _mm_mul_ps(vz, dt)));
+		_mm_store_ps(system->life_ + i, _mm_sub_ps(_mm_load_ps(system->life_ + i), dt));
+	}
+}
+
+
+void ParticleSystem::WriteVerticesBatch(void* context, int begin, int end){
+
+	ParticleSystem* system = static_cast<ParticleSystem*>(context);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 scale = _mm_set1_ps(255.0f);
+	const __m128 right_x = _mm_set1_ps(system->right_.x);
+	const __m128 right_y = _mm_set1_ps(system->right_.y);
+	const __m128 right_z = _mm_set1_ps(system->right_.z);
+	const __m128 up_x = _mm_set1_ps(system->up_.x);
+	const __m128 up_y = _mm_set1_ps(system->up_.y);
+	const __m128 up_z = _mm_set1_ps(system->up_.z);
+	const float corner_u[4] = {0.0f, 1.0f, 1.0f, 0.0f};
+	const float corner_v[4] = {0.0f, 0.0f, 1.0f, 1.0f};
+
+	for (int i = begin; i < end; i += 4){
+		/* Offsets from the centre to the corners, for four particles at once */
+		__m128 size = _mm_load_ps(system->size_ + i);
+		__m128 rx = _mm_mul_ps(right_x, size), ry = _mm_mul_ps(right_y, size), rz = _mm_mul_ps(right_z, size);
+		__m128 ux = _mm_mul_ps(up_x, size), uy = _mm_mul_ps(up_y, size), uz = _mm_mul_ps(up_z, size);
+		__m128 px = _mm_load_ps(system->pos_x_ + i);
+		__m128 py = _mm_load_ps(system->pos_y_ + i);
+		__m128 pz = _mm_load_ps(system->pos_z_ + i);
+
+		/* Corners in the order (-r -u), (+r -u), (+r +u), (-r +u) */
+		float corner[4][3][4];
+		_mm_storeu_ps(corner[0][0], _mm_sub_ps(_mm_sub_ps(px, rx), ux));
+		_mm_storeu_ps(corner[0][1], _mm_sub_ps(_mm_sub_ps(py, ry), uy));
+		_mm_storeu_ps(corner[0][2], _mm_sub_ps(_mm_sub_ps(pz, rz), uz));
+		_mm_storeu_ps(corner[1][0], _mm_sub_ps(_mm_add_ps(px, rx), ux));
+		_mm_storeu_ps(corner[1][1], _mm_sub_ps(_mm_add_ps(py, ry), uy));
+		_mm_storeu_ps(corner[1][2], _mm_sub_ps(_mm_add_ps(pz, rz), uz));
+		_mm_storeu_ps(corner[2][0], _mm_add_ps(_mm_add_ps(px, rx), ux));
+		_mm_storeu_ps(corner[2][1], _mm_add_ps(_mm_add_ps(py, ry), uy));
+		_mm_storeu_ps(corner[2][2], _mm_add_ps(_mm_add_ps(pz, rz), uz));
+		_mm_storeu_ps(corner[3][0], _mm_add_ps(_mm_sub_ps(px, rx), ux));
+		_mm_storeu_ps(corner[3][1], _mm_add_ps(_mm_sub_ps(py, ry), uy));
+		_mm_storeu_ps(corner[3][2], _mm_add_ps(_mm_sub_ps(pz, rz), uz));
+
+		/* Particles fade out over their lifetime; blending is additive, so the colour is scaled */
+		__m128 fade = _mm_mul_ps(_mm_max_ps(zero, _mm_mul_ps(_mm_load_ps(system->life_ + i), _mm_load_ps(system->inv_max_life_ + i))), scale);
+		__m128i red = _mm_cvtps_epi32(_mm_mul_ps(_mm_load_ps(system->red_ + i), fade));
+		__m128i green = _mm_cvtps_epi32(_mm_mul_ps(_mm_load_ps(system->green_ + i), fade));
+		__m128i blue = _mm_cvtps_epi32(_mm_mul_ps(_mm_load_ps(system->blue_ + i), fade));
+		__m128i packed = _mm_or_si128(_mm_or_si128(red, _mm_slli_epi32(green, 8)),
+			_mm_or_si128(_mm_slli_epi32(blue, 16), _mm_set1_epi32(0xFF000000)));
+		Ogre::uint32 colour[4];
+		_mm_storeu_si128((__m128i*) colour, packed);
+
+		int num = (end - i < 4) ? (end - i) : 4;
+		for (int k = 0; k < num; k++){
+			ParticleVertex* vertex = system->vertex_ + (i + k)*4;
+			for (int c = 0; c < 4; c++){
+				vertex[c].x = corner[c][0][k];
+				vertex[c].y = corner[c][1][k];
+				vertex[c].z = corner[c][2][k];
+				vertex[c].colour = colour[k];
+				vertex[c].u = corner_u[c];
+				vertex[c].v = corner_v[c];
+			}
+		}
+	}
+}
+
+} // namespace ogre_application;
@@ -0,0 +1,115 @@
+#ifndef PARTICLE_SYSTEM_H_
+#define PARTICLE_SYSTEM_H_
+
+#include "OGRE/OgreSimpleRenderable.h"
+#include "OGRE/OgreHardwareVertexBuffer.h"
+#include "OGRE/OgreCamera.h"
+#include "OGRE/OgreSceneManager.h"
+
+#include "worker_pool.h"
+
+namespace ogre_application {
+
+	/* Size of the particle pool; a multiple of four for SIMD and small enough
+	   for the quads to be indexed with 16-bit indices */
+	#define MAX_NUM_PARTICLES 16384
+	#define PARTICLE_RING_FRAMES 3 // Frames of vertices the dynamic buffer holds before it is discarded
+	#define PARTICLE_BATCH_SIZE 1024 // Particles handed to a worker thread at a time
+
+	/* Vertex layout of a particle quad corner */
+	struct ParticleVertex {
+		float x, y, z; // Position in world coordinates
+		Ogre::uint32 colour; // Colour packed as ABGR
+		float u, v; // Corner of the quad
+	};
+
+	/* Draws all particles with one call from a dynamic vertex buffer used as a ring:
+	   each frame appends its vertices without overwriting what the GPU may still read,
+	   and the buffer is only discarded when it wraps around */
+	class ParticleRenderable : public Ogre::SimpleRenderable {
+
+		public:
+			ParticleRenderable(void);
+			~ParticleRenderable(void);
+
+			void Init(const Ogre::String& material_name);
+
+			/* Reserve the vertices of num_particles quads; returns where to write them */
+			ParticleVertex* Lock(int num_particles);
+			void Unlock(void);
+
+			Ogre::Real getSquaredViewDepth(const Ogre::Camera* camera) const { return 0; }
+			Ogre::Real getBoundingRadius(void) const { return 0; }
+
+		private:
+			Ogre::HardwareVertexBufferSharedPtr vertex_buffer_;
+			size_t write_pos_; // First free vertex of the ring
+
+	}; // class ParticleRenderable
+
+	/* Sparks and debris kept in a preallocated pool in structure-of-arrays layout.
+	   Particles are simulated four at a time with SSE on the worker threads, and
+	   no memory is allocated after Init() */
+	class ParticleSystem {
+
+		public:
+			ParticleSystem(void);
+			~ParticleSystem(void);
+
+			void Init(Ogre::SceneManager* scene_manager, WorkerPool* worker_pool);
+
+			/* Release the GPU buffers; call before the render system shuts down */
+			void Destroy(void);
+
+			/* Sparks fly off a laser hit, mostly along dir */
+			void EmitSparks(const Ogre::Vector3& pos, const Ogre::Vector3& dir, int count);
+
+			/* Glowing debris of a destroyed asteroid */
+			void EmitDebris(const Ogre::Vector3& pos, int count);
+
+			/* Move the particles, remove the dead ones and stream the rest to the GPU */
+			void Update(const Ogre::Camera* camera, float elapsed_time);
+
+			int GetNumParticles(void) const { return num_particles_; }
+
+		private:
+			/* Particle pool, each array 16-byte aligned */
+			float* memory_;
+			float* pos_x_;
+			float* pos_y_;
+			float* pos_z_;
+			float* vel_x_;
+			float* vel_y_;
+			float* vel_z_;
+			float* life_; // Remaining lifetime in seconds
+			float* inv_max_life_; // One over the lifetime at creation
+			float* drag_; // Fraction of the velocity lost per second
+			float* size_; // Half the width of the quad
+			float* red_;
+			float* green_;
+			float* blue_;
+			int num_particles_;
+
+			WorkerPool* worker_pool_;
+			ParticleRenderable* renderable_;
+			Ogre::SceneNode* node_;
+			unsigned int random_state_;
+
+			/* State shared with the batch tasks of the current update */
+			float elapsed_time_;
+			Ogre::Vector3 right_;
+			Ogre::Vector3 up_;
+			ParticleVertex* vertex_;
+
+			float Random(void);
+			void Emit(const Ogre::Vector3& pos, const Ogre::Vector3& vel, float life, float drag, float size, float red, float green, float blue);
+			void Kill(int i);
+
+			static void SimulateBatch(void* context, int begin, int end);
+			static void WriteVerticesBatch(void* context, int begin, int end);
+
+	}; // class ParticleSystem
+
+} // namespace ogre_application;
+
+#endif // PARTICLE_SYSTEM_H_
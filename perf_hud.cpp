@@ -0,0 +1,232 @@
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+#include "OGRE/OgreResourceGroupManager.h"
+#include "OGRE/OgreLogManager.h"
+#include "OGRE/OgreStringConverter.h"
+#include "OGRE/Overlay/OgreOverlayManager.h"
+#include "OGRE/Overlay/OgreFontManager.h"
+
+#include "perf_hud.h"
+
+namespace ogre_application {
+
+/* Font, loaded from the font directory into its own resource group */
+const Ogre::String hud_resource_group_g = "PerfHud";
+const Ogre::String hud_font_name_g = "PerfHudFont";
+const Ogre::String hud_font_file_g = "bluehigh.ttf";
+const float hud_char_height_g = 16.0f;
+
+/* Layout in pixels */
+const float hud_left_g = 10.0f;
+const float hud_top_g = 10.0f;
+const float hud_width_g = 340.0f;
+const float hud_text_height_g = 100.0f;
+const float hud_graph_height_g = 60.0f;
+const float hud_margin_g = 8.0f;
+const float hud_graph_max_time_g = 0.05f; // Frame time at the top of the graph
+const float hud_target_time_g = 1.0f/60.0f; // Frame time of the target line
+
+
+PerfHud::PerfHud(void){
+
+	overlay_ = NULL;
+	panel_ = NULL;
+	text_ = NULL;
+	for (int i = 0; i < HUD_GRAPH_SAMPLES; i++){
+		bar_[i] = NULL;
+		frame_time_[i] = 0.0f;
+	}
+	target_line_ = NULL;
+	worker_pool_ = NULL;
+	next_sample_ = 0;
+	period_time_ = 0.0f;
+	period_frames_ = 0;
+	period_max_frame_time_ = 0.0f;
+	period_simulation_time_ = 0.0f;
+	period_collision_time_ = 0.0f;
+	caption_[0] = '\0';
+	next_caption_[0] = '\0';
+	caption_changed_ = false;
+}
+
+
+bool PerfHud::Init(WorkerPool* worker_pool, const Ogre::String& font_directory){
+
+	worker_pool_ = worker_pool;
+
+	/* Without the font there is no HUD, but the application still runs */
+	try {
+		Ogre::ResourceGroupManager& resource_group_manager = Ogre::ResourceGroupManager::getSingleton();
+		resource_group_manager.createResourceGroup(hud_resource_group_g);
+		resource_group_manager.addResourceLocation(font_directory, "FileSystem", hud_resource_group_g, false);
+		resource_group_manager.initialiseResourceGroup(hud_resource_group_g);
+
+		Ogre::FontPtr font = Ogre::FontManager::getSingleton().create(hud_font_name_g, hud_resource_group_g).staticCast<Ogre::Font>();
+		font->setType(Ogre::FT_TRUETYPE);
+		font->setSource(hud_font_file_g);
+		font->setTrueTypeSize(hud_char_height_g);
+		font->setTrueTypeResolution(96);
+		font->addCodePointRange(Ogre::Font::CodePointRange(32, 126));
+		font->load();
+	}
+	catch (Ogre::Exception &e){
+		Ogre::LogManager::getSingleton().logMessage("Performance HUD disabled: " + e.getDescription());
+		return false;
+	}
+
+	Ogre::OverlayManager& overlay_manager = Ogre::OverlayManager::getSingleton();
+	overlay_ = overlay_manager.create("PerfHudOverlay");
+	overlay_->setZOrder(600);
+
+	/* Background */
+	panel_ = CreatePanel("PerfHudPanel", "HudPanel");
+	panel_->setPosition(hud_left_g, hud_top_g);
+	panel_->setDimensions(hud_width_g, hud_text_height_g + hud_graph_height_g + 3.0f*hud_margin_g);
+	overlay_->add2D(panel_);
+
+	/* Statistics */
+	text_ = static_cast<Ogre::TextAreaOverlayElement*>(overlay_manager.createOverlayElement("TextArea", "PerfHudText"));
+	text_->setMetricsMode(Ogre::GMM_PIXELS);
+	text_->setPosition(hud_margin_g, hud_margin_g);
+	text_->setDimensions(hud_width_g - 2.0f*hud_margin_g, hud_text_height_g);
+	text_->setFontName(hud_font_name_g);
+	text_->setCharHeight(hud_char_height_g);
+	text_->setColour(Ogre::ColourValue(1.0f, 1.0f, 1.0f));
+	panel_->addChild(text_);
+
+	/* Frame time graph, one bar per frame */
+	float bar_width = (hud_width_g - 2.0f*hud_margin_g) / HUD_GRAPH_SAMPLES;
+	float graph_bottom = hud_text_height_g + 2.0f*hud_margin_g + hud_graph_height_g;
+	for (int i = 0; i < HUD_GRAPH_SAMPLES; i++){
+		bar_[i] = CreatePanel("PerfHudBar" + Ogre::StringConverter::toString(i), "HudBar");
+		bar_[i]->setPosition(hud_margin_g + i*bar_width, graph_bottom);
+		bar_[i]->setDimensions(bar_width, 0.0f);
+		panel_->addChild(bar_[i]);
+	}
+	target_line_ = CreatePanel("PerfHudTarget", "HudLine");
+	target_line_->setPosition(hud_margin_g, graph_bottom - hud_graph_height_g*hud_target_time_g/hud_graph_max_time_g);
+	target_line_->setDimensions(hud_width_g - 2.0f*hud_margin_g, 1.0f);
+	panel_->addChild(target_line_);
+
+	overlay_->hide();
+	return true;
+}
+
+
+Ogre::PanelOverlayElement* PerfHud::CreatePanel(const Ogre::String& name, const Ogre::String& material_name){
+
+	Ogre::PanelOverlayElement* panel = static_cast<Ogre::PanelOverlayElement*>(
+		Ogre::OverlayManager::getSingleton().createOverlayElement("Panel", name));
+	panel->setMetricsMode(Ogre::GMM_PIXELS);
+	panel->setMaterialName(material_name);
+	return panel;
+}
+
+
+void PerfHud::Destroy(void){
+
+	if (overlay_ == NULL){
+		return;
+	}
+
+	/* Children first */
+	Ogre::OverlayManager& overlay_manager = Ogre::OverlayManager::getSingleton();
+	for (int i = 0; i < HUD_GRAPH_SAMPLES; i++){
+		overlay_manager.destroyOverlayElement(bar_[i]);
+		bar_[i] = NULL;
+	}
+	overlay_manager.destroyOverlayElement(target_line_);
+	overlay_manager.destroyOverlayElement(text_);
+	overlay_manager.destroyOverlayElement(panel_);
+	overlay_manager.destroy(overlay_);
+	target_line_ = NULL;
+	text_ = NULL;
+	panel_ = NULL;
+	overlay_ = NULL;
+}
+
+
+void PerfHud::Toggle(void){
+
+	if (overlay_ == NULL){
+		return;
+	}
+	if (overlay_->isVisible()){
+		overlay_->hide();
+	} else {
+		overlay_->show();
+	}
+}
+
+
+void PerfHud::Update(float frame_time, float simulation_time, float collision_time,
+	const Ogre::RenderTarget::FrameStats& stats, int num_visible_asteroids, int num_asteroids){
+
+	if (overlay_ == NULL){
+		return;
+	}
+
+	frame_time_[next_sample_] = frame_time;
+	next_sample_ = (next_sample_ + 1) % HUD_GRAPH_SAMPLES;
+	period_time_ += frame_time;
+	period_frames_++;
+	period_max_frame_time_ = std::max(period_max_frame_time_, frame_time);
+	period_simulation_time_ += simulation_time;
+	period_collision_time_ += collision_time;
+
+	bool visible = overlay_->isVisible();
+	if (visible){
+		/* Oldest frame on the left */
+		float graph_bottom = hud_text_height_g + 2.0f*hud_margin_g + hud_graph_height_g;
+		for (int i = 0; i < HUD_GRAPH_SAMPLES; i++){
+			float t = frame_time_[(next_sample_ + i) % HUD_GRAPH_SAMPLES];
+			float height = hud_graph_height_g * std::min(t / hud_graph_max_time_g, 1.0f);
+			bar_[i]->setTop(graph_bottom - height);
+			bar_[i]->setHeight(height);
+		}
+	}
+
+	if (period_time_ < HUD_REFRESH_PERIOD){
+		return;
+	}
+
+	/* Averages of the period, in milliseconds; the periods also run while the
+	   HUD is hidden so the utilisation shown is always recent */
+	float frames = (float) period_frames_;
+	float utilisation = worker_pool_->GetUtilisation();
+	if (visible){
+		snprintf(next_caption_, sizeof(next_caption_),
+			"FPS %.1f   frame %.2f ms (max %.2f)\n"
+			"Batches %u   triangles %u\n"
+			"Asteroids %d visible of %d\n"
+			"Simulation %.2f ms   collision %.2f ms\n"
+			"Worker threads %d   busy %.0f%%",
+			frames / period_time_, 1000.0f*period_time_/frames, 1000.0f*period_max_frame_time_,
+			(unsigned int) stats.batchCount, (unsigned int) stats.triangleCount,
+			num_visible_asteroids, num_asteroids,
+			1000.0f*period_simulation_time_/frames, 1000.0f*period_collision_time_/frames,
+			worker_pool_->GetNumThreads(), 100.0f*utilisation);
+		caption_changed_ = (strcmp(next_caption_, caption_) != 0);
+	}
+
+	period_time_ = 0.0f;
+	period_frames_ = 0;
+	period_max_frame_time_ = 0.0f;
+	period_simulation_time_ = 0.0f;
+	period_collision_time_ = 0.0f;
+}
+
+
+void PerfHud::PresentCaption(void){
+
+	if ((overlay_ == NULL) || !caption_changed_){
+		return;
+	}
+	strcpy(caption_, next_caption_);
+	text_->setCaption(caption_);
+	caption_changed_ = false;
+}
+
+} // namespace ogre_application;
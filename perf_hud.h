@@ -0,0 +1,69 @@
+#ifndef PERF_HUD_H_
+#define PERF_HUD_H_
+
+#include "OGRE/OgreRenderTarget.h"
+#include "OGRE/Overlay/OgreOverlay.h"
+#include "OGRE/Overlay/OgrePanelOverlayElement.h"
+#include "OGRE/Overlay/OgreTextAreaOverlayElement.h"
+
+#include "worker_pool.h"
+
+namespace ogre_application {
+
+	#define HUD_GRAPH_SAMPLES 64 // Frames shown in the frame time graph
+	#define HUD_REFRESH_PERIOD 0.25f // Seconds between updates of the text
+
+	/* Panel with frame statistics drawn with the Overlay library. The graph is updated
+	   every frame by resizing preallocated bars; the text is rebuilt a few times per
+	   second from averages over that period */
+	class PerfHud {
+
+		public:
+			PerfHud(void);
+
+			/* Create the panel, hidden; the font is loaded from font_directory. Returns
+			   false, leaving the HUD disabled, if the font cannot be loaded */
+			bool Init(WorkerPool* worker_pool, const Ogre::String& font_directory);
+
+			/* Release the overlay elements; call before the render system shuts down */
+			void Destroy(void);
+
+			void Toggle(void);
+
+			/* Add the timings of a frame, in seconds, and refresh what is shown */
+			void Update(float frame_time, float simulation_time, float collision_time,
+				const Ogre::RenderTarget::FrameStats& stats, int num_visible_asteroids, int num_asteroids);
+
+			/* Hand new text to the overlay; the caption is rebuilt as a string, so call
+			   this where the frame loop may allocate */
+			void PresentCaption(void);
+
+		private:
+			Ogre::Overlay* overlay_;
+			Ogre::PanelOverlayElement* panel_;
+			Ogre::TextAreaOverlayElement* text_;
+			Ogre::PanelOverlayElement* bar_[HUD_GRAPH_SAMPLES];
+			Ogre::PanelOverlayElement* target_line_; // Marks the frame time of 60 fps
+			WorkerPool* worker_pool_;
+
+			float frame_time_[HUD_GRAPH_SAMPLES]; // Ring of the latest frame times
+			int next_sample_;
+
+			/* Sums over the current refresh period */
+			float period_time_;
+			int period_frames_;
+			float period_max_frame_time_;
+			float period_simulation_time_;
+			float period_collision_time_;
+
+			char caption_[512];
+			char next_caption_[512]; // Built by Update, shown by PresentCaption
+			bool caption_changed_;
+
+			Ogre::PanelOverlayElement* CreatePanel(const Ogre::String& name, const Ogre::String& material_name);
+
+	}; // class PerfHud
+
+} // namespace ogre_application;
+
+#endif // PERF_HUD_H_
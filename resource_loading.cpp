@@ -0,0 +1,156 @@
+#include "resource_loading.h"
+
+namespace ogre_application {
+
+/* Share of the overall progress taken by each stage */
+const float scripting_weight_g = 0.4f;
+const float prepare_weight_g = 0.2f;
+const float load_weight_g = 0.4f;
+
+
+ResourceLoadingListener::ResourceLoadingListener(LoadingProgressCallback callback){
+
+	callback_ = callback;
+	main_thread_ = std::this_thread::get_id();
+	stage_start_ = 0.0f;
+	stage_weight_ = 0.0f;
+	stage_total_ = 0;
+	stage_done_ = 0;
+	changed_ = false;
+	reported_progress_ = -1.0f;
+}
+
+
+void ResourceLoadingListener::ReportProgress(void){
+
+	float progress;
+	Ogre::String stage;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (!changed_){
+			return;
+		}
+		progress = stage_start_;
+		if (stage_total_ > 0){
+			progress += stage_weight_ * float(stage_done_) / float(stage_total_);
+		}
+		stage = stage_name_;
+		changed_ = false;
+	}
+
+	if ((callback_ != NULL) && (progress != reported_progress_)){
+		callback_(progress, stage);
+	}
+	reported_progress_ = progress;
+}
+
+
+void ResourceLoadingListener::BeginStage(float start, float weight, size_t total, const Ogre::String& name){
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stage_start_ = start;
+		stage_weight_ = weight;
+		stage_total_ = total;
+		stage_done_ = 0;
+		stage_name_ = name;
+		changed_ = true;
+	}
+
+	/* On the main thread nobody is polling, so report right away */
+	if (std::this_thread::get_id() == main_thread_){
+		ReportProgress();
+	}
+}
+
+
+void ResourceLoadingListener::AdvanceStage(const Ogre::String& name){
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (stage_done_ < stage_total_){
+			stage_done_++;
+		}
+		if (!name.empty()){
+			stage_name_ = name;
+		}
+		changed_ = true;
+	}
+
+	if (std::this_thread::get_id() == main_thread_){
+		ReportProgress();
+	}
+}
+
+
+void ResourceLoadingListener::resourceGroupScriptingStarted(const Ogre::String& group_name, size_t script_count){
+
+	BeginStage(0.0f, scripting_weight_g, script_count, "Parsing scripts of " + group_name);
+}
+
+
+void ResourceLoadingListener::scriptParseStarted(const Ogre::String& script_name, bool& skip_this_script){
+
+	skip_this_script = false;
+}
+
+
+void ResourceLoadingListener::scriptParseEnded(const Ogre::String& script_name, bool skipped){
+
+	AdvanceStage("Parsed " + script_name);
+}
+
+
+void ResourceLoadingListener::resourceGroupScriptingEnded(const Ogre::String& group_name){
+
+	BeginStage(scripting_weight_g, 0.0f, 0, "Parsed scripts of " + group_name);
+}
+
+
+void ResourceLoadingListener::resourceGroupPrepareStarted(const Ogre::String& group_name, size_t resource_count){
+
+	BeginStage(scripting_weight_g, prepare_weight_g, resource_count, "Preparing " + group_name);
+}
+
+
+void ResourceLoadingListener::resourcePrepareStarted(const Ogre::ResourcePtr& resource){
+}
+
+
+void ResourceLoadingListener::resourcePrepareEnded(void){
+
+	AdvanceStage("");
+}
+
+
+void ResourceLoadingListener::resourceGroupPrepareEnded(const Ogre::String& group_name){
+
+	BeginStage(scripting_weight_g + prepare_weight_g, 0.0f, 0, "Prepared " + group_name);
+}
+
+
+void ResourceLoadingListener::resourceGroupLoadStarted(const Ogre::String& group_name, size_t resource_count){
+
+	BeginStage(scripting_weight_g + prepare_weight_g, load_weight_g, resource_count, "Loading " + group_name);
+}
+
+
+void ResourceLoadingListener::resourceLoadStarted(const Ogre::ResourcePtr& resource){
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	stage_name_ = "Loading " + resource->getName();
+}
+
+
+void ResourceLoadingListener::resourceLoadEnded(void){
+
+	AdvanceStage("");
+}
+
+
+void ResourceLoadingListener::resourceGroupLoadEnded(const Ogre::String& group_name){
+
+	BeginStage(1.0f, 0.0f, 0, "Loaded " + group_name);
+}
+
+} // namespace ogre_application;
@@ -0,0 +1,69 @@
+#ifndef RESOURCE_LOADING_H_
+#define RESOURCE_LOADING_H_
+
+#include <mutex>
+#include <thread>
+
+#include "OGRE/OgreResourceGroupManager.h"
+
+namespace ogre_application {
+
+	/* Receives the progress of resource loading, between 0 and 1, and a description of the current stage */
+	typedef void (*LoadingProgressCallback)(float progress, const Ogre::String& stage);
+
+	/* Tracks the progress of a resource group through scripting, preparing and loading.
+	   OGRE may call the listener from its background thread, so progress is stored under
+	   a lock and handed to the callback on the thread that created the listener */
+	class ResourceLoadingListener : public Ogre::ResourceGroupListener {
+
+		public:
+			ResourceLoadingListener(LoadingProgressCallback callback);
+
+			/* Pass the latest progress to the callback if it changed; call from the main thread */
+			void ReportProgress(void);
+
+			/* Scripting stage: parse material and program scripts */
+			void resourceGroupScriptingStarted(const Ogre::String& group_name, size_t script_count);
+			void scriptParseStarted(const Ogre::String& script_name, bool& skip_this_script);
+			void scriptParseEnded(const Ogre::String& script_name, bool skipped);
+			void resourceGroupScriptingEnded(const Ogre::String& group_name);
+
+			/* Preparing stage: read resource data from disk */
+			void resourceGroupPrepareStarted(const Ogre::String& group_name, size_t resource_count);
+			void resourcePrepareStarted(const Ogre::ResourcePtr& resource);
+			void resourcePrepareEnded(void);
+			void resourceGroupPrepareEnded(const Ogre::String& group_name);
+
+			/* Loading stage: create the GPU objects */
+			void resourceGroupLoadStarted(const Ogre::String& group_name, size_t resource_count);
+			void resourceLoadStarted(const Ogre::ResourcePtr& resource);
+			void resourceLoadEnded(void);
+			void resourceGroupLoadEnded(const Ogre::String& group_name);
+
+			/* Not used */
+			void worldGeometryStageStarted(const Ogre::String& description) {}
+			void worldGeometryStageEnded(void) {}
+
+		private:
+			LoadingProgressCallback callback_;
+			std::thread::id main_thread_;
+			std::mutex mutex_;
+
+			/* Progress of the current stage, guarded by mutex_ */
+			float stage_start_; // Overall progress when the stage started
+			float stage_weight_; // Share of the overall progress taken by the stage
+			size_t stage_total_; // Number of items in the stage
+			size_t stage_done_; // Number of items finished
+			Ogre::String stage_name_;
+			bool changed_;
+
+			float reported_progress_;
+
+			void BeginStage(float start, float weight, size_t total, const Ogre::String& name);
+			void AdvanceStage(const Ogre::String& name);
+
+	}; // class ResourceLoadingListener
+
+} // namespace ogre_application;
+
+#endif // RESOURCE_LOADING_H_
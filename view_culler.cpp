@@ -0,0 +1,129 @@
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#include "view_culler.h"
+
+namespace ogre_application {
+
+ViewCuller::ViewCuller(void){
+
+	num_views_ = 0;
+	num_groups_ = 0;
+}
+
+
+int ViewCuller::AddView(const Ogre::Camera* camera){
+
+	if (num_views_ == MAX_VIEWS){
+		return -1;
+	}
+	camera_[num_views_] = camera;
+	return num_views_++;
+}
+
+
+ViewCuller::Cone ViewCuller::Bound(int view) const {
+
+	/* The corners of the far plane are the furthest from the axis, both in angle
+	   and in distance from the camera */
+	const Ogre::Camera* camera = camera_[view];
+	float tan_y = tan(camera->getFOVy().valueRadians()*0.5f);
+	float tan_x = tan_y*camera->getAspectRatio();
+	float tan_corner = sqrt(tan_x*tan_x + tan_y*tan_y);
+
+	float far_distance = camera->getFarClipDistance();
+
+	Cone cone;
+	cone.apex = camera->getDerivedPosition();
+	cone.axis = camera->getDerivedDirection();
+	cone.angle = atan(tan_corner);
+	cone.range = (far_distance == 0.0f) ? std::numeric_limits<float>::max() : far_distance*sqrt(1.0f + tan_corner*tan_corner);
+	cone.views = 1u << view;
+	return cone;
+}
+
+
+bool ViewCuller::Merge(Cone& group, const Cone& cone){
+
+	/* Smallest cone from the apex of the group around both direction cones */
+	float between = acos(std::max(-1.0f, std::min(1.0f, group.axis.dotProduct(cone.axis))));
+	Cone merged = group;
+	if (between + cone.angle <= group.angle){
+		/* Already inside */
+	} else if (between + group.angle <= cone.angle){
+		merged.axis = cone.axis;
+		merged.angle = cone.angle;
+	} else {
+		/* The axis turns towards the cone by what the angle grows on the side of the group */
+		merged.angle = 0.5f*(between + group.angle + cone.angle);
+		float turn = merged.angle - group.angle;
+		merged.axis = (group.axis*sin(between - turn) + cone.axis*sin(turn))/sin(between);
+		merged.axis.normalise();
+	}
+
+	float offset = group.apex.distance(cone.apex);
+	if ((merged.angle > MAX_SHARED_ANGLE) || (offset > MAX_SHARED_APEX_OFFSET)){
+		return false;
+	}
+
+	/* Moving the apex back by offset/sin(angle) puts the whole ball of radius offset
+	   around the old apex inside the cone, so the other camera's cone is inside too */
+	float back = 0.0f;
+	if (offset > 0.0f){
+		back = offset/sin(merged.angle);
+		merged.apex -= merged.axis*back;
+	}
+	merged.range = std::max(group.range, cone.range + offset) + back;
+	merged.views = group.views | cone.views;
+	group = merged;
+	return true;
+}
+
+
+void ViewCuller::Update(void){
+
+	num_groups_ = 0;
+	for (int v = 0; v < num_views_; v++){
+		Cone cone = Bound(v);
+		bool shared = false;
+		for (int g = 0; (g < num_groups_) && !shared; g++){
+			shared = Merge(group_[g], cone);
+		}
+		if (!shared){
+			group_[num_groups_++] = cone;
+		}
+	}
+
+	for (int g = 0; g < num_groups_; g++){
+		group_[g].cos_angle = cos(group_[g].angle);
+		group_[g].sin_angle = sin(group_[g].angle);
+	}
+}
+
+
+unsigned int ViewCuller::Test(const Ogre::Vector3& centre, float radius) const {
+
+	unsigned int views = 0;
+	for (int g = 0; g < num_groups_; g++){
+		const Cone& cone = group_[g];
+		Ogre::Vector3 v = centre - cone.apex;
+		float distance_squared = v.squaredLength();
+		float reach = cone.range + radius;
+		if (distance_squared > reach*reach){
+			continue;
+		}
+
+		/* Distance of the centre outside the cone surface, measured in the plane of
+		   the axis; behind the apex it is at most the distance to the apex */
+		float along = v.dotProduct(cone.axis);
+		float across = sqrt(std::max(0.0f, distance_squared - along*along));
+		if (across*cone.cos_angle - along*cone.sin_angle > radius){
+			continue;
+		}
+		views |= cone.views;
+	}
+	return views;
+}
+
+} // namespace ogre_application;
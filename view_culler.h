@@ -0,0 +1,57 @@
+#ifndef VIEW_CULLER_H_
+#define VIEW_CULLER_H_
+
+#include "OGRE/OgreCamera.h"
+
+namespace ogre_application {
+
+	#define MAX_VIEWS 8 // Cameras drawing the field at the same time; one bit each in a view mask
+	#define MAX_SHARED_ANGLE 1.05f // Widest half angle in radians of a cone shared by several views
+	#define MAX_SHARED_APEX_OFFSET 50.0f // Furthest apart two cameras can be and share a cone
+
+	/* Finds, in a single pass over the field, which of several cameras may see each
+	   asteroid. The frustum of a camera is bounded by a cone from its position, and
+	   cameras close together looking in nearby directions share one wider cone, so a
+	   view near another one adds no work. The test is conservative; the render
+	   system still culls every viewport exactly */
+	class ViewCuller {
+
+		public:
+			ViewCuller(void);
+
+			/* Views keep the order they are added in, which gives their bit in the masks;
+			   each sees as far as the far clip distance of its camera */
+			int AddView(const Ogre::Camera* camera);
+			int GetNumViews(void) const { return num_views_; }
+
+			/* Bound the views again; call once per frame after the cameras have moved */
+			void Update(void);
+
+			/* Mask of the views that may see the sphere */
+			unsigned int Test(const Ogre::Vector3& centre, float radius) const;
+
+		private:
+			/* Views that are tested together */
+			struct Cone {
+				Ogre::Vector3 apex;
+				Ogre::Vector3 axis; // Unit direction
+				float angle; // Half angle in radians
+				float cos_angle;
+				float sin_angle;
+				float range; // Distance from the apex beyond which nothing is seen
+				unsigned int views; // Mask of the views inside the cone
+			};
+
+			const Ogre::Camera* camera_[MAX_VIEWS];
+			int num_views_;
+			Cone group_[MAX_VIEWS];
+			int num_groups_;
+
+			Cone Bound(int view) const;
+			static bool Merge(Cone& group, const Cone& cone);
+
+	}; // class ViewCuller
+
+} // namespace ogre_application;
+
+#endif // VIEW_CULLER_H_
@@ -0,0 +1,148 @@
+#include <chrono>
+
+#include "worker_pool.h"
+
+namespace ogre_application {
+
+/* Current time in microseconds */
+static long long Microseconds(void){
+
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+WorkerPool::WorkerPool(void){
+
+	task_ = NULL;
+	context_ = NULL;
+	count_ = 0;
+	batch_size_ = 1;
+	generation_ = 0;
+	busy_workers_ = 0;
+	quit_ = false;
+	next_batch_ = 0;
+	busy_microseconds_ = 0;
+	utilisation_start_ = Microseconds();
+}
+
+
+WorkerPool::~WorkerPool(void){
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		quit_ = true;
+	}
+	work_ready_.notify_all();
+	for (size_t i = 0; i < thread_.size(); i++){
+		thread_[i].join();
+	}
+}
+
+
+void WorkerPool::Init(int num_threads){
+
+	if (num_threads <= 0){
+		num_threads = (int) std::thread::hardware_concurrency() - 1;
+	}
+	for (int i = 0; i < num_threads; i++){
+		thread_.push_back(std::thread(&WorkerPool::WorkerMain, this));
+	}
+	utilisation_start_ = Microseconds();
+}
+
+
+void WorkerPool::ParallelFor(Task task, void* context, int count, int batch_size){
+
+	/* Small loops are not worth waking the workers for */
+	if (thread_.empty() || (count <= batch_size)){
+		if (count > 0){
+			task(context, 0, count);
+		}
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		task_ = task;
+		context_ = context;
+		count_ = count;
+		batch_size_ = batch_size;
+		next_batch_ = 0;
+		busy_workers_ = (int) thread_.size();
+		generation_++;
+	}
+	work_ready_.notify_all();
+
+	RunBatches(task, context, count, batch_size);
+
+	/* The loop is only done when every worker has left it */
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (busy_workers_ > 0){
+		work_done_.wait(lock);
+	}
+}
+
+
+float WorkerPool::GetUtilisation(void){
+
+	long long now = Microseconds();
+	long long elapsed = now - utilisation_start_;
+	long long busy = busy_microseconds_.exchange(0);
+	utilisation_start_ = now;
+
+	if (thread_.empty() || (elapsed <= 0)){
+		return 0.0f;
+	}
+	return float(busy) / float(elapsed * (long long) thread_.size());
+}
+
+
+void WorkerPool::WorkerMain(void){
+
+	unsigned int seen_generation = 0;
+	while (true){
+		Task task;
+		void* context;
+		int count, batch_size;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			while (!quit_ && (generation_ == seen_generation)){
+				work_ready_.wait(lock);
+			}
+			if (quit_){
+				return;
+			}
+			seen_generation = generation_;
+			task = task_;
+			context = context_;
+			count = count_;
+			batch_size = batch_size_;
+		}
+
+		long long start = Microseconds();
+		RunBatches(task, context, count, batch_size);
+		busy_microseconds_ += Microseconds() - start;
+
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			busy_workers_--;
+		}
+		work_done_.notify_one();
+	}
+}
+
+
+void WorkerPool::RunBatches(Task task, void* context, int count, int batch_size){
+
+	/* Threads take batches until none are left */
+	while (true){
+		int begin = next_batch_.fetch_add(1) * batch_size;
+		if (begin >= count){
+			return;
+		}
+		int end = (begin + batch_size < count) ? (begin + batch_size) : count;
+		task(context, begin, end);
+	}
+}
+
+} // namespace ogre_application;
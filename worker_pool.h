@@ -0,0 +1,60 @@
+#ifndef WORKER_POOL_H_
+#define WORKER_POOL_H_
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+namespace ogre_application {
+
+	/* A fixed set of worker threads that split loops into batches. The calling
+	   thread works on batches as well and returns when the whole loop is done */
+	class WorkerPool {
+
+		public:
+			/* Processes the elements [begin, end) of a loop */
+			typedef void (*Task)(void* context, int begin, int end);
+
+			WorkerPool(void);
+			~WorkerPool(void);
+
+			/* Start the threads; zero picks one thread less than the number of cores */
+			void Init(int num_threads);
+
+			/* Run the task over [0, count) in batches of batch_size elements */
+			void ParallelFor(Task task, void* context, int count, int batch_size);
+
+			int GetNumThreads(void) const { return (int) thread_.size(); }
+
+			/* Fraction of time the worker threads spent on tasks since the last call */
+			float GetUtilisation(void);
+
+		private:
+			std::vector<std::thread> thread_;
+			std::mutex mutex_;
+			std::condition_variable work_ready_;
+			std::condition_variable work_done_;
+
+			/* Current loop, guarded by mutex_ */
+			Task task_;
+			void* context_;
+			int count_;
+			int batch_size_;
+			unsigned int generation_; // Incremented for every loop so workers notice new work
+			int busy_workers_;
+			bool quit_;
+
+			std::atomic<int> next_batch_;
+			std::atomic<long long> busy_microseconds_;
+			long long utilisation_start_; // Time of the last GetUtilisation() call, in microseconds
+
+			void WorkerMain(void);
+			void RunBatches(Task task, void* context, int count, int batch_size);
+
+	}; // class WorkerPool
+
+} // namespace ogre_application;
+
+#endif // WORKER_POOL_H_